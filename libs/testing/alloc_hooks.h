@@ -0,0 +1,157 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_ALLOC_HOOKS_H
+#define _TESTING_ALLOC_HOOKS_H
+
+/*
+ *  Opt-in replacement of the global operator new/delete which counts the
+ *  allocations of every thread for the perf timers and the
+ *  PERF_EXPECT_NO_ALLOC/PERF_EXPECT_MAX_ALLOCS checks.
+ *
+ *  The replacement functions are not inline, so the header must be included
+ *  in exactly one translation unit of the test program.
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include "testing/details/alloc_counters.h"
+#include "testing/details/heap_profiler.h"
+
+namespace testing {
+namespace details {
+
+inline void* counted_alloc(std::size_t size, std::size_t align) noexcept
+{
+    size = (size == 0) ? 1 : size;
+    void* p = nullptr;
+    if (align <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else if (::posix_memalign(&p, align, size) != 0) {
+        p = nullptr;
+    }
+    if (p != nullptr) {
+        alloc_counts& counts = thread_alloc_counts();
+        ++counts.allocs;
+        counts.bytes += ::malloc_usable_size(p);
+        heap_profiler::on_alloc(size);
+    }
+    return p;
+}
+
+inline void* counted_alloc_or_throw(std::size_t size, std::size_t align)
+{
+    for (;;) {
+        void* p = counted_alloc(size, align);
+        if (p != nullptr) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+inline void counted_free(void* p) noexcept
+{
+    if (p == nullptr) {
+        return;
+    }
+    alloc_counts& counts = thread_alloc_counts();
+    ++counts.frees;
+    counts.freed_bytes += ::malloc_usable_size(p);
+    std::free(p);
+}
+
+[[maybe_unused]] static const bool __g_alloc_hooks_installed = (alloc_hooks_flag() = true);
+
+} // namespace details
+} // namespace testing
+
+void* operator new(std::size_t size)
+{
+    return ::testing::details::counted_alloc_or_throw(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::testing::details::counted_alloc_or_throw(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return ::testing::details::counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return ::testing::details::counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return ::testing::details::counted_alloc_or_throw(size, (std::size_t)align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return ::testing::details::counted_alloc_or_throw(size, (std::size_t)align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return ::testing::details::counted_alloc(size, (std::size_t)align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return ::testing::details::counted_alloc(size, (std::size_t)align);
+}
+
+void operator delete(void* p) noexcept { ::testing::details::counted_free(p); }
+void operator delete[](void* p) noexcept { ::testing::details::counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { ::testing::details::counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { ::testing::details::counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { ::testing::details::counted_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    ::testing::details::counted_free(p);
+}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    ::testing::details::counted_free(p);
+}
+
+#endif /* _TESTING_ALLOC_HOOKS_H */
@@ -0,0 +1,85 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_ALLOC_COUNTERS_H
+#define _TESTING_ALLOC_COUNTERS_H
+
+#include <cstdint>
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Heap activity of a thread. Bytes are the usable sizes of the
+ *          blocks, so a block is counted the same on allocation and free.
+ */
+struct alloc_counts
+{
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+    uint64_t frees = 0;
+    uint64_t freed_bytes = 0;
+
+    int64_t live_bytes() const { return (int64_t)bytes - (int64_t)freed_bytes; }
+
+    alloc_counts& operator+=(const alloc_counts& other)
+    {
+        allocs += other.allocs;
+        bytes += other.bytes;
+        frees += other.frees;
+        freed_bytes += other.freed_bytes;
+        return *this;
+    }
+
+    alloc_counts operator-(const alloc_counts& other) const
+    {
+        alloc_counts res;
+        res.allocs = allocs - other.allocs;
+        res.bytes = bytes - other.bytes;
+        res.frees = frees - other.frees;
+        res.freed_bytes = freed_bytes - other.freed_bytes;
+        return res;
+    }
+};
+
+/* Counters of the calling thread, updated by testing/alloc_hooks.h. */
+inline alloc_counts& thread_alloc_counts()
+{
+    static thread_local alloc_counts counts;
+    return counts;
+}
+
+inline bool& alloc_hooks_flag()
+{
+    static bool is_installed = false;
+    return is_installed;
+}
+
+/* True if the program replaced operator new/delete with testing/alloc_hooks.h. */
+inline bool is_alloc_hooks_installed() { return alloc_hooks_flag(); }
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_ALLOC_COUNTERS_H */
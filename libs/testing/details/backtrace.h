@@ -0,0 +1,70 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_BACKTRACE_H
+#define _TESTING_BACKTRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#if defined(__unix__)
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #define __TESTING_HAS_BACKTRACE
+#endif
+
+#include "testing/details/common_test_utils.h"
+
+namespace testing {
+namespace details {
+
+/* Demangled name of the function at 'addr', or the module and the offset in it. */
+inline std::string symbolize(void* addr)
+{
+#if defined(__TESTING_HAS_BACKTRACE)
+    ::Dl_info info;
+    if (::dladdr(addr, &info) != 0) {
+        if (info.dli_sname != nullptr) {
+            return demangle(info.dli_sname);
+        }
+        if (info.dli_fname != nullptr) {
+            std::ostringstream ss;
+            const char* p_base = std::strrchr(info.dli_fname, '/');
+            ss << ((p_base != nullptr) ? p_base + 1 : info.dli_fname) << "+0x" << std::hex
+               << ((uintptr_t)addr - (uintptr_t)info.dli_fbase);
+            return ss.str();
+        }
+    }
+#endif
+    std::ostringstream ss;
+    ss << addr;
+    return ss.str();
+}
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_BACKTRACE_H */
@@ -0,0 +1,90 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_BARRIER_H
+#define _TESTING_BARRIER_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Reusable barrier which releases all waiting threads at once. The
+ *          waiters spin for a short while, so the release is not delayed by
+ *          a futex wake-up, and yield afterwards.
+ */
+class barrier final
+{
+public:
+    explicit barrier(size_t count)
+        : m_count(count)
+    {}
+
+    barrier(const barrier&) = delete;
+    barrier& operator=(const barrier&) = delete;
+
+    void arrive_and_wait()
+    {
+        const size_t generation = m_generation.load(std::memory_order_acquire);
+        if (m_arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == m_count) {
+            m_arrived.store(0, std::memory_order_relaxed);
+            m_generation.fetch_add(1, std::memory_order_release);
+            return;
+        }
+
+        const size_t spin_count = 4096;
+        for (size_t i = 0; m_generation.load(std::memory_order_acquire) == generation; ++i) {
+            if (i < spin_count) {
+                pause();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+
+private:
+    const size_t m_count;
+    std::atomic<size_t> m_arrived{0};
+    std::atomic<size_t> m_generation{0};
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_BARRIER_H */
@@ -0,0 +1,108 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_BENCHMARK_STATE_H
+#define _TESTING_BENCHMARK_STATE_H
+
+#include <cstdint>
+
+#include "testing/details/timer.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  State of a PERF_BENCHMARK body run for a fixed number of
+ *          iterations. The body loops 'for (auto _ : state)'; the timer
+ *          runs from the first to the last iteration.
+ */
+class benchmark_state final
+{
+public:
+    /* Non-trivial, so the unused loop variable does not produce warnings. */
+    struct value
+    {
+        value() {}
+        ~value() {}
+    };
+
+    class iterator final
+    {
+    public:
+        iterator(benchmark_state* p_state, uint64_t remaining)
+            : m_p_state(p_state)
+            , m_remaining(remaining)
+        {}
+
+        value operator*() const { return value(); }
+
+        iterator& operator++()
+        {
+            --m_remaining;
+            return *this;
+        }
+
+        bool operator!=(const iterator&)
+        {
+            if (m_remaining != 0) {
+                return true;
+            }
+            m_p_state->m_sw.pause();
+            return false;
+        }
+
+    private:
+        benchmark_state* m_p_state;
+        uint64_t m_remaining;
+    };
+
+    explicit benchmark_state(uint64_t iterations)
+        : m_iterations(iterations)
+    {}
+
+    iterator begin()
+    {
+        m_sw.start();
+        return iterator(this, m_iterations);
+    }
+
+    iterator end() { return iterator(this, 0); }
+
+    void pause_timing()  { m_sw.pause(); }
+    void resume_timing() { m_sw.start(); }
+
+    uint64_t iterations() const { return m_iterations; }
+
+    uint64_t elapsed_ns() const { return m_sw.value_ns(); }
+
+private:
+    const uint64_t m_iterations;
+    perf_timer m_sw;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_BENCHMARK_STATE_H */
+
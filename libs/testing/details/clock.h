@@ -0,0 +1,274 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_CLOCK_H
+#define _TESTING_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <cpuid.h>
+    #include <x86intrin.h>
+    #define __TESTING_HAS_TSC
+#endif
+
+namespace testing {
+namespace details {
+
+enum class clock_type
+{
+    steady,
+    monotonic_raw,
+    thread_cpu,
+    tsc
+};
+
+inline const char* clock_name(clock_type type)
+{
+    switch (type) {
+    case clock_type::steady:        return "steady";
+    case clock_type::monotonic_raw: return "monotonic_raw";
+    case clock_type::thread_cpu:    return "thread_cpu";
+    case clock_type::tsc:           return "tsc";
+    }
+    return "unknown";
+}
+
+inline bool parse_clock_type(const std::string& name, clock_type& type)
+{
+    for (clock_type t : {clock_type::steady, clock_type::monotonic_raw,
+                         clock_type::thread_cpu, clock_type::tsc}) {
+        if (name == clock_name(t)) {
+            type = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ *  \brief  Clock policies.
+ *
+ *  A policy provides start() and stop() readings in its own ticks and
+ *  converts ticks to nanoseconds. start() and stop() differ only for the
+ *  serializing TSC reads.
+ */
+
+struct steady_clock final
+{
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t start() { return now(); }
+    static uint64_t stop()  { return now(); }
+
+    static uint64_t to_ns(uint64_t ticks) { return ticks; }
+    static double ns_per_tick() { return 1.0; }
+};
+
+template<clockid_t TClockId>
+struct posix_clock final
+{
+    static uint64_t now()
+    {
+        struct ::timespec ts;
+        ::clock_gettime(TClockId, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    static uint64_t start() { return now(); }
+    static uint64_t stop()  { return now(); }
+
+    static uint64_t to_ns(uint64_t ticks) { return ticks; }
+    static double ns_per_tick() { return 1.0; }
+};
+
+using monotonic_raw_clock = posix_clock<CLOCK_MONOTONIC_RAW>;
+using thread_cpu_clock = posix_clock<CLOCK_THREAD_CPUTIME_ID>;
+
+struct tsc_clock final
+{
+#if defined(__TESTING_HAS_TSC)
+    /* lfence keeps rdtsc from executing before the preceding instructions. */
+    static uint64_t start()
+    {
+        _mm_lfence();
+        const uint64_t ticks = __rdtsc();
+        _mm_lfence();
+        return ticks;
+    }
+
+    /* rdtscp waits for the measured code, lfence keeps the following out. */
+    static uint64_t stop()
+    {
+        unsigned int aux;
+        const uint64_t ticks = __rdtscp(&aux);
+        _mm_lfence();
+        return ticks;
+    }
+
+    static bool is_invariant()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (! __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (edx & (1u << 8)) != 0;
+    }
+#else
+    static uint64_t start() { return steady_clock::now(); }
+    static uint64_t stop()  { return steady_clock::now(); }
+
+    static bool is_invariant() { return false; }
+#endif
+
+    static uint64_t to_ns(uint64_t ticks) { return (uint64_t)((double)ticks * ns_per_tick()); }
+
+    /* Calibrated once against the steady clock over a short busy wait. */
+    static double ns_per_tick()
+    {
+#if defined(__TESTING_HAS_TSC)
+        static const double ratio = [] () -> double {
+            const uint64_t calibration_ns = 20000000;
+
+            const uint64_t ns_begin = steady_clock::now();
+            const uint64_t ticks_begin = start();
+            uint64_t ns_end = ns_begin;
+            while (ns_end - ns_begin < calibration_ns) {
+                ns_end = steady_clock::now();
+            }
+            const uint64_t ticks_end = stop();
+            return (double)(ns_end - ns_begin) / (double)(ticks_end - ticks_begin);
+        }();
+        return ratio;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+/*
+ *  \brief  Approximate duration of a CPU cycle in nanoseconds: the TSC
+ *          period where available, otherwise the maximal cpufreq frequency,
+ *          otherwise a 5 GHz guess, so it errs on the short side.
+ */
+inline double cpu_cycle_ns()
+{
+    static const double cycle_ns = [] () -> double {
+#if defined(__TESTING_HAS_TSC)
+        if (tsc_clock::is_invariant()) {
+            return tsc_clock::ns_per_tick();
+        }
+#endif
+        FILE* p_file = ::fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+        if (p_file != nullptr) {
+            unsigned long khz = 0;
+            const int res = ::fscanf(p_file, "%lu", &khz);
+            ::fclose(p_file);
+            if (res == 1 && khz != 0) {
+                return 1000000.0 / (double)khz;
+            }
+        }
+        return 0.2;
+    }();
+    return cycle_ns;
+}
+
+/*
+ *  \brief  Clock of the perf timers, selected at runtime per test. The
+ *          selection is atomic, the worker threads of a test read it.
+ */
+struct perf_clock final
+{
+    static clock_type current() { return selected().load(std::memory_order_relaxed); }
+
+    static void select(clock_type type)
+    {
+        if (type == clock_type::tsc) {
+            static const bool is_checked = [] () -> bool {
+                if (! tsc_clock::is_invariant()) {
+                    std::cerr << "[ WARNING  ] TSC is not invariant, tsc clock "
+                              << "results may be inaccurate." << std::endl;
+                }
+                return true;
+            }();
+            (void)is_checked;
+            tsc_clock::ns_per_tick();
+        }
+        selected().store(type, std::memory_order_relaxed);
+    }
+
+    static uint64_t start()
+    {
+        switch (current()) {
+        case clock_type::monotonic_raw: return monotonic_raw_clock::start();
+        case clock_type::thread_cpu:    return thread_cpu_clock::start();
+        case clock_type::tsc:           return tsc_clock::start();
+        default:                        return steady_clock::start();
+        }
+    }
+
+    static uint64_t stop()
+    {
+        switch (current()) {
+        case clock_type::monotonic_raw: return monotonic_raw_clock::stop();
+        case clock_type::thread_cpu:    return thread_cpu_clock::stop();
+        case clock_type::tsc:           return tsc_clock::stop();
+        default:                        return steady_clock::stop();
+        }
+    }
+
+    static uint64_t to_ns(uint64_t ticks)
+    {
+        return (current() == clock_type::tsc) ? tsc_clock::to_ns(ticks) : ticks;
+    }
+
+    static double ns_per_tick()
+    {
+        return (current() == clock_type::tsc) ? tsc_clock::ns_per_tick() : 1.0;
+    }
+
+private:
+    static std::atomic<clock_type>& selected()
+    {
+        static std::atomic<clock_type> type(clock_type::steady);
+        return type;
+    }
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_CLOCK_H */
+
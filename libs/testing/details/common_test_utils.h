@@ -31,6 +31,7 @@
 #endif
 
 #include <cstring>
+#include <memory>
 #include <string>
 
 // Check RTTI enabling for typeid
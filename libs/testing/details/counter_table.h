@@ -0,0 +1,124 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_COUNTER_TABLE_H
+#define _TESTING_COUNTER_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace testing {
+namespace details {
+
+enum class counter_kind
+{
+    total,          /* Printed as is. */
+    per_iteration,  /* Divided by the intervals of the timer. */
+    rate,           /* Divided by the time of the timer, per second. */
+    bytes,          /* Rate in bytes per second. */
+    items           /* Rate in items per second. */
+};
+
+struct counter
+{
+    std::string name;
+    double value = 0.0;
+    counter_kind kind = counter_kind::total;
+    /* Index of the timer the derived values are computed from. */
+    size_t timer_idx = main_timer;
+
+    /* The benchmark measurement if any, the test body timer otherwise. */
+    static constexpr size_t main_timer = (size_t)-1;
+};
+
+/*
+ *  \brief  The value of a counter as it is reported, derived from the time
+ *          and the intervals of its timer.
+ */
+inline double derived_value(const counter& c, uint64_t ns, uint64_t count)
+{
+    switch (c.kind) {
+    case counter_kind::per_iteration:
+        return (count != 0) ? c.value / (double)count : 0.0;
+    case counter_kind::rate:
+    case counter_kind::bytes:
+    case counter_kind::items:
+        return (ns != 0) ? c.value * 1000000000.0 / (double)ns : 0.0;
+    default:
+        return c.value;
+    }
+}
+
+/*
+ *  \brief  User counters of a perf test run, in the order of their first
+ *          use. A counter is keyed by its name and timer.
+ */
+class counter_table final
+{
+public:
+    /* Repeated calls accumulate the value until the next reset. */
+    void add(const std::string& name, double value, counter_kind kind,
+             size_t timer_idx = counter::main_timer)
+    {
+        const std::string key = name + "@" + std::to_string(timer_idx);
+        std::unordered_map<std::string, size_t>::const_iterator it = m_ids.find(key);
+        if (it == m_ids.cend()) {
+            it = m_ids.emplace(key, m_counters.size()).first;
+            m_counters.emplace_back();
+        }
+
+        counter& c = m_counters[it->second];
+        c.name = name;
+        c.value += value;
+        c.kind = kind;
+        c.timer_idx = timer_idx;
+    }
+
+    void reset()
+    {
+        for (counter& c : m_counters) {
+            c.value = 0.0;
+        }
+    }
+
+    void clear()
+    {
+        m_counters.clear();
+        m_ids.clear();
+    }
+
+    const std::vector<counter>& counters() const { return m_counters; }
+
+private:
+    std::vector<counter> m_counters;
+    std::unordered_map<std::string, size_t> m_ids;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_COUNTER_TABLE_H */
+
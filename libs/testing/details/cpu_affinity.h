@@ -0,0 +1,241 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_CPU_AFFINITY_H
+#define _TESTING_CPU_AFFINITY_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+#endif
+
+namespace testing {
+namespace details {
+
+/* Parses a CPU list in the format of cpusets and taskset, e.g. "0,2,4-7". */
+inline bool parse_cpu_list(const std::string& value, std::vector<int>& cpus)
+{
+    const auto parse_cpu = [](const std::string& item, int& cpu) -> bool {
+        if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos || item.size() > 6) {
+            return false;
+        }
+        cpu = std::atoi(item.c_str());
+        return true;
+    };
+
+    cpus.clear();
+    for (size_t pos = 0; pos <= value.size(); ) {
+        size_t end = value.find(',', pos);
+        end = (end == std::string::npos) ? value.size() : end;
+        const std::string item = value.substr(pos, end - pos);
+        const size_t dash_pos = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (dash_pos == std::string::npos) {
+            if (! parse_cpu(item, first)) {
+                return false;
+            }
+            last = first;
+        } else if (! parse_cpu(item.substr(0, dash_pos), first)
+                   || ! parse_cpu(item.substr(dash_pos + 1), last) || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.emplace_back(cpu);
+        }
+        pos = end + 1;
+    }
+    return ! cpus.empty();
+}
+
+/* CPU the calling thread runs on, -1 if unknown. */
+inline int current_cpu()
+{
+#if defined(__linux__)
+    return ::sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+/*
+ *  \brief  CPUs a timer ran on, read at the start and at the pause of every
+ *          interval. A migration is a change of the CPU between two reads.
+ */
+struct cpu_placement
+{
+    int first_cpu = -1;
+    int last_cpu = -1;
+    uint64_t migrations = 0;
+
+    void record(int cpu)
+    {
+        if (cpu < 0) {
+            return;
+        }
+        if (first_cpu < 0) {
+            first_cpu = cpu;
+        } else if (cpu != last_cpu) {
+            ++migrations;
+        }
+        last_cpu = cpu;
+    }
+};
+
+#if defined(__linux__)
+/* Affinity of the process before the first thread was pinned. */
+inline const cpu_set_t& initial_affinity()
+{
+    static const cpu_set_t set = [] {
+        cpu_set_t res;
+        CPU_ZERO(&res);
+        if (::sched_getaffinity(0, sizeof(res), &res) != 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                CPU_SET(cpu, &res);
+            }
+        }
+        return res;
+    }();
+    return set;
+}
+#endif
+
+/*
+ *  \brief  Pins the calling thread to a set of CPUs and switches it to
+ *          SCHED_FIFO on request. The destructor restores the previous
+ *          affinity and policy, so it must run on the same thread.
+ */
+class cpu_binding final
+{
+public:
+    cpu_binding() = default;
+    cpu_binding(const cpu_binding&) = delete;
+    cpu_binding& operator=(const cpu_binding&) = delete;
+
+    ~cpu_binding() { restore(); }
+
+    bool pin(const std::vector<int>& cpus)
+    {
+#if defined(__linux__)
+        initial_affinity();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (! m_is_pinned && ::sched_getaffinity(0, sizeof(m_prev_set), &m_prev_set) != 0) {
+            return false;
+        }
+        if (::sched_setaffinity(0, sizeof(set), &set) != 0) {
+            return false;
+        }
+        m_is_pinned = true;
+        return true;
+#else
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    /* Needs CAP_SYS_NICE or RLIMIT_RTPRIO, the thread keeps its policy otherwise. */
+    bool set_fifo()
+    {
+#if defined(__linux__)
+        if (! m_is_fifo && ::pthread_getschedparam(::pthread_self(), &m_prev_policy, &m_prev_param) != 0) {
+            return false;
+        }
+        struct ::sched_param param;
+        param.sched_priority = ::sched_get_priority_min(SCHED_FIFO);
+        if (::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param) != 0) {
+            return false;
+        }
+        m_is_fifo = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void restore()
+    {
+#if defined(__linux__)
+        if (m_is_fifo) {
+            ::pthread_setschedparam(::pthread_self(), m_prev_policy, &m_prev_param);
+        }
+        if (m_is_pinned) {
+            ::sched_setaffinity(0, sizeof(m_prev_set), &m_prev_set);
+        }
+#endif
+        m_is_fifo = false;
+        m_is_pinned = false;
+    }
+
+private:
+    bool m_is_pinned = false;
+    bool m_is_fifo = false;
+#if defined(__linux__)
+    cpu_set_t m_prev_set;
+    int m_prev_policy = SCHED_OTHER;
+    struct ::sched_param m_prev_param = {};
+#endif
+};
+
+/*
+ *  \brief  Returns a helper thread started by a bound one, e.g. a sampler,
+ *          to the initial affinity and SCHED_OTHER, so a SCHED_FIFO thread
+ *          on its CPU does not starve it.
+ */
+inline void unbind_thread()
+{
+#if defined(__linux__)
+    struct ::sched_param param;
+    param.sched_priority = 0;
+    ::pthread_setschedparam(::pthread_self(), SCHED_OTHER, &param);
+    ::sched_setaffinity(0, sizeof(cpu_set_t), &initial_affinity());
+#endif
+}
+
+/* Locks the current and the future pages of the process into memory, once. */
+inline bool lock_memory()
+{
+#if defined(__linux__)
+    static const bool is_locked = (::mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+    return is_locked;
+#else
+    return false;
+#endif
+}
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_CPU_AFFINITY_H */
@@ -0,0 +1,102 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_CPU_TIME_H
+#define _TESTING_CPU_TIME_H
+
+#include <cstdint>
+
+#include <time.h>
+#if defined(__unix__)
+    #include <sys/resource.h>
+    #include <sys/time.h>
+#endif
+
+namespace testing {
+namespace details {
+
+struct cpu_usage
+{
+    uint64_t user_ns = 0;
+    uint64_t system_ns = 0;
+
+    uint64_t total_ns() const { return user_ns + system_ns; }
+};
+
+inline uint64_t timespec_ns(const struct ::timespec& ts)
+{
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* CPU time consumed by all threads of the process, in nanoseconds. */
+inline uint64_t process_cpu_time_ns()
+{
+    struct ::timespec ts;
+    if (::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return timespec_ns(ts);
+}
+
+/* CPU time consumed by the calling thread, in nanoseconds. */
+inline uint64_t thread_cpu_time_ns()
+{
+    struct ::timespec ts;
+    if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return timespec_ns(ts);
+}
+
+#if defined(__unix__)
+inline cpu_usage rusage_cpu_usage(int who)
+{
+    cpu_usage usage;
+    struct ::rusage ru;
+    if (::getrusage(who, &ru) != 0) {
+        return usage;
+    }
+    usage.user_ns = (uint64_t)ru.ru_utime.tv_sec * 1000000000ull + (uint64_t)ru.ru_utime.tv_usec * 1000ull;
+    usage.system_ns = (uint64_t)ru.ru_stime.tv_sec * 1000000000ull + (uint64_t)ru.ru_stime.tv_usec * 1000ull;
+    return usage;
+}
+
+/* User and system split of the process CPU time. */
+inline cpu_usage process_cpu_usage() { return rusage_cpu_usage(RUSAGE_SELF); }
+
+/* User and system split of the calling thread CPU time. */
+inline cpu_usage thread_cpu_usage()
+{
+#if defined(RUSAGE_THREAD)
+    return rusage_cpu_usage(RUSAGE_THREAD);
+#else
+    return process_cpu_usage();
+#endif
+}
+#endif
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_CPU_TIME_H */
@@ -0,0 +1,278 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_HEAP_PROFILER_H
+#define _TESTING_HEAP_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "testing/details/backtrace.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Sampling heap profiler fed by testing/alloc_hooks.h.
+ *
+ *  Allocations are sampled as a Poisson process over the allocated bytes with
+ *  the mean 'sample_interval', so the cost per allocation is a countdown and
+ *  only about one allocation per interval pays for a backtrace. Every sample
+ *  is weighted by the inverse of its sampling probability, which gives
+ *  unbiased estimates of bytes and counts per call site.
+ */
+class heap_profiler final
+{
+public:
+    static constexpr size_t max_frames = 24;
+    static constexpr size_t max_sites = 4096;
+
+    struct site
+    {
+        uint64_t hash = 0;
+        size_t depth = 0;
+        void* frames[max_frames] = {};
+        double bytes = 0.0;
+        double count = 0.0;
+        uint64_t samples = 0;
+    };
+
+    static heap_profiler& get_instance()
+    {
+        static heap_profiler instance;
+        return instance;
+    }
+
+    /* Clears the sites and starts sampling. Must not be called from a hook. */
+    void start(size_t sample_interval)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sites.assign(max_sites, site());
+        m_used = 0;
+        m_dropped = 0;
+#if defined(__TESTING_HAS_BACKTRACE)
+        /* The first backtrace() loads the unwinder, which allocates. */
+        void* frames[1];
+        ::backtrace(frames, 1);
+#endif
+        interval().store(sample_interval, std::memory_order_relaxed);
+    }
+
+    void stop() { interval().store(0, std::memory_order_relaxed); }
+
+    bool is_active() const { return interval().load(std::memory_order_relaxed) != 0; }
+
+    /* Hot path of every counted allocation of 'size' bytes. */
+    static void on_alloc(size_t size)
+    {
+        const uint64_t sample_interval = interval().load(std::memory_order_relaxed);
+        if (sample_interval == 0) {
+            return;
+        }
+
+        thread_state& st = state();
+        st.countdown -= (int64_t)size;
+        if (st.countdown > 0 || st.is_sampling) {
+            return;
+        }
+
+        st.is_sampling = true;
+        if (st.is_init) {
+            get_instance().record(size, sample_interval);
+        }
+        st.is_init = true;
+        st.countdown = next_countdown(st, sample_interval);
+        st.is_sampling = false;
+    }
+
+    /* Prints the 'top' call sites by estimated bytes and by estimated count. */
+    void print(std::ostream& os, size_t top, const std::string& prefix) const
+    {
+        std::vector<site> sites;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const site& s : m_sites) {
+                if (s.samples != 0) {
+                    sites.emplace_back(s);
+                }
+            }
+        }
+
+        os << prefix << "heap profile: " << sites.size() << " call sites";
+        if (m_dropped != 0) {
+            os << ", " << m_dropped << " samples dropped";
+        }
+        os << std::endl;
+
+        const auto print_top = [&](const std::string& title, bool by_bytes) {
+            std::sort(sites.begin(), sites.end(), [by_bytes](const site& l, const site& r) {
+                return by_bytes ? l.bytes > r.bytes : l.count > r.count;
+            });
+            os << prefix << "  top by " << title << ":" << std::endl;
+            for (size_t i = 0; i < std::min(top, sites.size()); ++i) {
+                os << prefix << "    " << std::setw(12) << (uint64_t)sites[i].bytes << " bytes "
+                   << std::setw(10) << (uint64_t)sites[i].count << " allocs  "
+                   << describe(sites[i]) << std::endl;
+            }
+        };
+        print_top("bytes", true);
+        print_top("count", false);
+    }
+
+private:
+    struct thread_state
+    {
+        int64_t countdown = 0;
+        uint64_t rng = 0;
+        bool is_init = false;
+        bool is_sampling = false;
+    };
+
+    heap_profiler() = default;
+
+    static std::atomic<uint64_t>& interval()
+    {
+        static std::atomic<uint64_t> sample_interval(0);
+        return sample_interval;
+    }
+
+    static thread_state& state()
+    {
+        static thread_local thread_state st;
+        return st;
+    }
+
+    static int64_t next_countdown(thread_state& st, uint64_t sample_interval)
+    {
+        if (st.rng == 0) {
+            st.rng = (uint64_t)(uintptr_t)&st ^ 0x9e3779b97f4a7c15ull;
+        }
+        /* xorshift64* */
+        st.rng ^= st.rng >> 12;
+        st.rng ^= st.rng << 25;
+        st.rng ^= st.rng >> 27;
+        const uint64_t r = st.rng * 0x2545f4914f6cdd1dull;
+        const double u = ((double)(r >> 11) + 1.0) / 9007199254740993.0;
+        return (int64_t)(-std::log(u) * (double)sample_interval) + 1;
+    }
+
+    void record(size_t size, uint64_t sample_interval)
+    {
+#if defined(__TESTING_HAS_BACKTRACE)
+        void* frames[max_frames];
+        const int depth = ::backtrace(frames, (int)max_frames);
+        uint64_t hash = 14695981039346656037ull;
+        for (int i = 0; i < depth; ++i) {
+            hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+        }
+        hash = (hash == 0) ? 1 : hash;
+
+        /* Sampling probability of the allocation in the Poisson process. */
+        const double p = 1.0 - std::exp(-(double)size / (double)sample_interval);
+        const double weight = (p > 0.0) ? 1.0 / p : 1.0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < max_sites; ++i) {
+            site& s = m_sites[(hash + i) & (max_sites - 1)];
+            if (s.hash != hash && s.samples != 0) {
+                continue;
+            }
+            if (s.samples == 0) {
+                if (m_used * 4 >= max_sites * 3) {
+                    break;
+                }
+                ++m_used;
+                s.hash = hash;
+                s.depth = (size_t)depth;
+                std::copy(frames, frames + depth, s.frames);
+            }
+            s.bytes += weight * (double)size;
+            s.count += weight;
+            ++s.samples;
+            return;
+        }
+        ++m_dropped;
+#else
+        (void)size;
+        (void)sample_interval;
+#endif
+    }
+
+    /* Frames of the call site outside of the allocation and standard library code. */
+    static std::string describe(const site& s)
+    {
+        static const std::string long_string =
+            "std::__cxx11::basic_string<char, std::char_traits<char>, std::allocator<char> >";
+
+        std::ostringstream ss;
+        size_t printed = 0;
+        for (size_t i = 0; i < s.depth && printed < 3; ++i) {
+            std::string name = symbolize(s.frames[i]);
+            if (is_library_frame(name)) {
+                continue;
+            }
+            for (size_t pos = name.find(long_string); pos != std::string::npos;
+                 pos = name.find(long_string, pos)) {
+                name.replace(pos, long_string.size(), "std::string");
+            }
+            ss << ((printed == 0) ? "" : " < ") << name;
+            ++printed;
+        }
+        return ss.str();
+    }
+
+    static bool is_library_frame(const std::string& name)
+    {
+        static const char* const prefixes[] = {
+            "testing::details::heap_profiler", "testing::details::counted_", "operator new",
+            "std::", "__gnu_cxx::", "void std::", "__libc_start"
+        };
+        for (const char* prefix : prefixes) {
+            if (name.compare(0, std::strlen(prefix), prefix) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<site> m_sites;
+    size_t m_used = 0;
+    uint64_t m_dropped = 0;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_HEAP_PROFILER_H */
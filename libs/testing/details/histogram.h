@@ -0,0 +1,221 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_HISTOGRAM_H
+#define _TESTING_HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "testing/details/stats.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Log-linear histogram of 64-bit values in the spirit of HDR
+ *          histograms.
+ *
+ *  Values below 2^sub_bucket_bits are counted exactly. Above that, every
+ *  power of two range is split into 2^(sub_bucket_bits - 1) linear
+ *  sub-buckets, so the relative error is below 2^(1 - sub_bucket_bits)
+ *  (0.8%). Memory is constant and record() is O(1).
+ */
+class histogram final
+{
+public:
+    static constexpr unsigned sub_bucket_bits = 8;
+    static constexpr uint64_t sub_bucket_count = 1ull << sub_bucket_bits;
+    static constexpr uint64_t half_count = sub_bucket_count / 2;
+    static constexpr size_t counts_size = sub_bucket_count + (64 - sub_bucket_bits) * half_count;
+
+    histogram()
+        : m_counts(counts_size, 0)
+    {}
+
+    void record(uint64_t value)
+    {
+        ++m_counts[index(value)];
+        ++m_total;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+        m_sum += (double)value;
+        m_sq_sum += (double)value * (double)value;
+    }
+
+    void merge(const histogram& other)
+    {
+        for (size_t i = 0; i < counts_size; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        m_sum += other.m_sum;
+        m_sq_sum += other.m_sq_sum;
+    }
+
+    void clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = 0;
+        m_min = UINT64_MAX;
+        m_max = 0;
+        m_sum = 0.0;
+        m_sq_sum = 0.0;
+    }
+
+    uint64_t count() const { return m_total; }
+
+    /* The highest value equivalent to the p-th percentile, p in [0, 100]. */
+    uint64_t percentile(double p) const
+    {
+        if (m_total == 0) {
+            return 0;
+        }
+
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100.0 * (double)m_total));
+        uint64_t acc = 0;
+        for (size_t i = 0; i < counts_size; ++i) {
+            acc += m_counts[i];
+            if (acc >= rank) {
+                return std::min(std::max(highest_equivalent(i), m_min), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    /* Summary of the values scaled by 'scale', e.g. ticks to nanoseconds. */
+    summary summarize(double scale = 1.0) const
+    {
+        summary s;
+        if (m_total == 0) {
+            return s;
+        }
+
+        const double n = (double)m_total;
+        s.count = m_total;
+        s.min = (double)m_min * scale;
+        s.max = (double)m_max * scale;
+        s.mean = m_sum / n * scale;
+        const double variance = (m_total > 1) ? (m_sq_sum - m_sum * m_sum / n) / (n - 1.0) : 0.0;
+        s.stddev = std::sqrt(std::max(variance, 0.0)) * scale;
+        s.median = (double)percentile(50.0) * scale;
+        s.p90 = (double)percentile(90.0) * scale;
+        s.p99 = (double)percentile(99.0) * scale;
+        s.p999 = (double)percentile(99.9) * scale;
+        return s;
+    }
+
+    /*
+     *  \brief  Prints the distribution over power of two ranges of values,
+     *          one line per range between min and max.
+     */
+    void print(std::ostream& os, const std::string& prefix, double scale = 1.0,
+               const std::string& unit = "nsecs") const
+    {
+        const size_t bar_width = 40;
+        if (m_total == 0) {
+            return;
+        }
+
+        const unsigned lo_exp = log2_floor(m_min);
+        const unsigned hi_exp = log2_floor(m_max);
+        std::vector<uint64_t> ranges(hi_exp - lo_exp + 1, 0);
+        for (size_t i = 0; i < counts_size; ++i) {
+            if (m_counts[i] != 0) {
+                const unsigned e = log2_floor(lowest_equivalent(i));
+                ranges[std::min(std::max(e, lo_exp), hi_exp) - lo_exp] += m_counts[i];
+            }
+        }
+
+        const uint64_t max_range = *std::max_element(ranges.cbegin(), ranges.cend());
+        for (size_t r = 0; r < ranges.size(); ++r) {
+            const unsigned e = lo_exp + (unsigned)r;
+            const double lo = (e == 0) ? 0.0 : std::ldexp(1.0, e) * scale;
+            const double hi = std::ldexp(1.0, e + 1) * scale;
+            const size_t bar = (size_t)((double)ranges[r] / (double)max_range * bar_width);
+            os << prefix << "[" << std::setw(10) << (uint64_t)lo << ", " << std::setw(10)
+               << (uint64_t)hi << ") " << unit << " " << std::string(bar, '#')
+               << std::string(bar_width - bar, ' ') << " " << std::fixed << std::setprecision(2)
+               << (100.0 * (double)ranges[r] / (double)m_total) << "%" << std::defaultfloat
+               << std::setprecision(6) << std::endl;
+        }
+    }
+
+private:
+    static unsigned log2_floor(uint64_t value)
+    {
+        return (value == 0) ? 0 : 63 - (unsigned)__builtin_clzll(value);
+    }
+
+    static size_t index(uint64_t value)
+    {
+        if (value < sub_bucket_count) {
+            return (size_t)value;
+        }
+        const unsigned e = log2_floor(value) - sub_bucket_bits + 1;
+        const uint64_t sub = value >> e;
+        return (size_t)(sub_bucket_count + (e - 1) * half_count + (sub - half_count));
+    }
+
+    static uint64_t lowest_equivalent(size_t idx)
+    {
+        if (idx < sub_bucket_count) {
+            return idx;
+        }
+        const uint64_t k = idx - sub_bucket_count;
+        const unsigned e = (unsigned)(k / half_count) + 1;
+        return (k % half_count + half_count) << e;
+    }
+
+    static uint64_t highest_equivalent(size_t idx)
+    {
+        if (idx < sub_bucket_count) {
+            return idx;
+        }
+        const uint64_t k = idx - sub_bucket_count;
+        const unsigned e = (unsigned)(k / half_count) + 1;
+        return lowest_equivalent(idx) + (1ull << e) - 1;
+    }
+
+private:
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+    double m_sum = 0.0;
+    double m_sq_sum = 0.0;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_HISTOGRAM_H */
+
@@ -0,0 +1,306 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_MACHINE_INFO_H
+#define _TESTING_MACHINE_INFO_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "testing/details/clock.h"
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/options.h"
+
+namespace testing {
+namespace details {
+
+struct cache_info
+{
+    size_t level = 0;
+    /* Data, Instruction or Unified. */
+    std::string type;
+    /* As reported by sysfs, e.g. 32K. */
+    std::string size;
+};
+
+/*
+ *  \brief  Fingerprint of the machine running the perf tests, read from
+ *          /proc and /sys, and the known sources of noise found in it. It
+ *          is collected once and attached to every perf result.
+ */
+class machine_info final
+{
+public:
+    static const machine_info& get_instance()
+    {
+        static const machine_info instance;
+        return instance;
+    }
+
+    void print(std::ostream& os) const
+    {
+        const std::string prefix = "[ MACHINE  ] ";
+        os << prefix << "cpu: " << (cpu_model.empty() ? "unknown" : cpu_model) << ", " << sockets
+           << " sockets, " << cores << " cores, " << logical_cpus << " threads, smt "
+           << (is_smt ? "on" : "off") << std::endl;
+        if (! caches.empty()) {
+            os << prefix << "caches:";
+            const char* sep = " ";
+            for (const cache_info& c : caches) {
+                os << sep << "L" << c.level << cache_suffix(c.type) << " " << c.size;
+                sep = ", ";
+            }
+            os << std::endl;
+        }
+        os << prefix << "cpu " << cpu << " frequency: governor " << or_unknown(governor);
+        if (max_freq_khz != 0) {
+            os << ", current " << cur_freq_khz / 1000 << " MHz, max " << max_freq_khz / 1000 << " MHz";
+        }
+        os << ", turbo " << or_unknown(turbo) << std::endl;
+        os << prefix << "load average: " << load_avg[0] << " " << load_avg[1] << " " << load_avg[2]
+           << ", thp: " << or_unknown(thp) << ", kernel: " << or_unknown(kernel) << std::endl;
+        os << prefix << "scheduler jitter: wake-up latency median " << (double)wakeup_median_ns / 1000.0
+           << " usecs, max " << (double)wakeup_max_ns / 1000.0 << " usecs, longest interruption "
+           << (double)max_gap_ns / 1000.0 << " usecs" << std::endl;
+        for (const std::string& warning : warnings) {
+            os << "[ WARNING  ] " << warning << std::endl;
+        }
+    }
+
+public:
+    std::string cpu_model;
+    size_t logical_cpus = 0;
+    size_t cores = 0;
+    size_t sockets = 0;
+    bool is_smt = false;
+    std::vector<cache_info> caches;
+    /* CPU of the frequency settings, the first one of the perf tests. */
+    int cpu = 0;
+    std::string governor;
+    uint64_t cur_freq_khz = 0;
+    uint64_t max_freq_khz = 0;
+    /* on, off or empty if unknown. */
+    std::string turbo;
+    double load_avg[3] = {0.0, 0.0, 0.0};
+    /* CPUs the load average is spread over. */
+    size_t online_cpus = 0;
+    std::string thp;
+    std::string kernel;
+    /* Oversleep of short sleeps and the longest stall of a busy loop. */
+    uint64_t wakeup_median_ns = 0;
+    uint64_t wakeup_max_ns = 0;
+    uint64_t max_gap_ns = 0;
+    std::vector<std::string> warnings;
+
+private:
+    machine_info()
+    {
+        const options& opts = options::get_instance();
+        cpu = ! opts.perf_cpus.empty() ? opts.perf_cpus.front()
+            : (! opts.perf_cpuset.empty() ? opts.perf_cpuset.front() : 0);
+
+        read_cpuinfo();
+        read_caches();
+        read_frequency();
+        std::istringstream(read_line("/proc/loadavg")) >> load_avg[0] >> load_avg[1] >> load_avg[2];
+        std::vector<int> online;
+        online_cpus = parse_cpu_list(read_line("/sys/devices/system/cpu/online"), online)
+            ? online.size() : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        thp = selected_value(read_line("/sys/kernel/mm/transparent_hugepage/enabled"));
+        kernel = read_line("/proc/sys/kernel/osrelease");
+        measure_jitter();
+        check_noise();
+    }
+
+    static std::string read_line(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    static uint64_t read_number(const std::string& path)
+    {
+        const std::string line = read_line(path);
+        return line.empty() ? 0 : std::strtoull(line.c_str(), nullptr, 10);
+    }
+
+    /* The value in brackets of a sysfs choice, e.g. "always [madvise] never". */
+    static std::string selected_value(const std::string& line)
+    {
+        const size_t begin = line.find('[');
+        const size_t end = line.find(']', begin);
+        return (begin == std::string::npos || end == std::string::npos)
+            ? line : line.substr(begin + 1, end - begin - 1);
+    }
+
+    static std::string or_unknown(const std::string& value) { return value.empty() ? "unknown" : value; }
+
+    static std::string cache_suffix(const std::string& type)
+    {
+        return (type == "Data") ? "d" : ((type == "Instruction") ? "i" : "");
+    }
+
+    std::string cpu_dir() const { return "/sys/devices/system/cpu/cpu" + std::to_string(cpu); }
+
+    void read_cpuinfo()
+    {
+        std::ifstream file("/proc/cpuinfo");
+        std::set<std::string> packages;
+        std::set<std::pair<std::string, std::string>> physical_cores;
+        std::string package;
+        std::string line;
+        while (std::getline(file, line)) {
+            const size_t colon_pos = line.find(':');
+            if (colon_pos == std::string::npos) {
+                continue;
+            }
+            std::string key = line.substr(0, colon_pos);
+            key.erase(key.find_last_not_of(" \t") + 1);
+            const std::string value = (colon_pos + 2 <= line.size()) ? line.substr(colon_pos + 2) : "";
+            if (key == "processor") {
+                ++logical_cpus;
+            } else if (key == "model name" && cpu_model.empty()) {
+                cpu_model = value;
+            } else if (key == "physical id") {
+                package = value;
+                packages.insert(value);
+            } else if (key == "core id") {
+                physical_cores.emplace(package, value);
+            }
+        }
+
+        logical_cpus = std::max<size_t>(logical_cpus, std::thread::hardware_concurrency());
+        sockets = std::max<size_t>(packages.size(), 1);
+        cores = physical_cores.empty() ? logical_cpus : physical_cores.size();
+        is_smt = (read_number("/sys/devices/system/cpu/smt/active") != 0) || cores < logical_cpus;
+    }
+
+    void read_caches()
+    {
+        for (size_t i = 0; ; ++i) {
+            const std::string dir = cpu_dir() + "/cache/index" + std::to_string(i);
+            const std::string level = read_line(dir + "/level");
+            if (level.empty()) {
+                break;
+            }
+            cache_info c;
+            c.level = (size_t)std::strtoull(level.c_str(), nullptr, 10);
+            c.type = read_line(dir + "/type");
+            c.size = read_line(dir + "/size");
+            caches.emplace_back(std::move(c));
+        }
+    }
+
+    void read_frequency()
+    {
+        const std::string freq_dir = cpu_dir() + "/cpufreq";
+        governor = read_line(freq_dir + "/scaling_governor");
+        cur_freq_khz = read_number(freq_dir + "/scaling_cur_freq");
+        max_freq_khz = read_number(freq_dir + "/cpuinfo_max_freq");
+
+        const std::string no_turbo = read_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+        const std::string boost = read_line("/sys/devices/system/cpu/cpufreq/boost");
+        if (! no_turbo.empty()) {
+            turbo = (no_turbo == "0") ? "on" : "off";
+        } else if (! boost.empty()) {
+            turbo = (boost == "1") ? "on" : "off";
+        }
+    }
+
+    /* Sleeps 100 usecs a few times, then spins for 10 msecs looking for stalls. */
+    void measure_jitter()
+    {
+        const size_t sleep_count = 50;
+        const uint64_t sleep_ns = 100000;
+        const uint64_t spin_ns = 10000000;
+
+        std::vector<uint64_t> latencies;
+        latencies.reserve(sleep_count);
+        for (size_t i = 0; i < sleep_count; ++i) {
+            const uint64_t begin_ns = steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
+            const uint64_t slept_ns = steady_clock::now() - begin_ns;
+            latencies.emplace_back((slept_ns > sleep_ns) ? slept_ns - sleep_ns : 0);
+        }
+        std::sort(latencies.begin(), latencies.end());
+        wakeup_median_ns = latencies[latencies.size() / 2];
+        wakeup_max_ns = latencies.back();
+
+        const uint64_t begin_ns = steady_clock::now();
+        for (uint64_t prev_ns = begin_ns, now_ns = begin_ns; now_ns - begin_ns < spin_ns; prev_ns = now_ns) {
+            now_ns = steady_clock::now();
+            max_gap_ns = std::max(max_gap_ns, now_ns - prev_ns);
+        }
+    }
+
+    void check_noise()
+    {
+        const uint64_t max_gap_limit_ns = 200000;
+        const double min_freq_ratio = 0.9;
+
+        if (! governor.empty() && governor != "performance") {
+            warnings.emplace_back("CPU frequency governor is '" + governor
+                                  + "', the perf tests may run at a lower frequency than 'performance' sets");
+        }
+        if (turbo == "on") {
+            warnings.emplace_back("Turbo boost is on, the CPU frequency depends on the load and the temperature");
+        }
+        if (max_freq_khz != 0 && (double)cur_freq_khz < min_freq_ratio * (double)max_freq_khz) {
+            warnings.emplace_back("CPU " + std::to_string(cpu) + " runs at " + std::to_string(cur_freq_khz / 1000)
+                                  + " of " + std::to_string(max_freq_khz / 1000) + " MHz, frequency scaling is active");
+        }
+        if (load_avg[0] >= (double)online_cpus) {
+            std::ostringstream os;
+            os << "Load average is " << load_avg[0] << " on " << online_cpus
+               << " online CPUs, other tasks compete for the CPUs";
+            warnings.emplace_back(os.str());
+        }
+        if (thp == "always") {
+            warnings.emplace_back("Transparent huge pages are 'always', faults and khugepaged vary the timings");
+        }
+        if (max_gap_ns > max_gap_limit_ns) {
+            std::ostringstream os;
+            os << "A busy thread was stalled for " << (double)max_gap_ns / 1000.0
+               << " usecs, the perf tests may be preempted";
+            warnings.emplace_back(os.str());
+        }
+    }
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_MACHINE_INFO_H */
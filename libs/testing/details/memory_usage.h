@@ -0,0 +1,217 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_MEMORY_USAGE_H
+#define _TESTING_MEMORY_USAGE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/cpu_time.h"
+
+namespace testing {
+namespace details {
+
+/* Resident set size of the process in bytes, 0 if unknown. */
+inline uint64_t rss_bytes()
+{
+#if defined(__linux__)
+    static const uint64_t page_size = (uint64_t)::sysconf(_SC_PAGESIZE);
+    const int fd = ::open("/proc/self/statm", O_RDONLY);
+    if (fd == -1) {
+        return 0;
+    }
+    char buffer[128];
+    const ssize_t size = ::read(fd, buffer, sizeof(buffer) - 1);
+    ::close(fd);
+    if (size <= 0) {
+        return 0;
+    }
+    buffer[size] = 0x00;
+
+    unsigned long long total_pages = 0;
+    unsigned long long resident_pages = 0;
+    if (std::sscanf(buffer, "%llu %llu", &total_pages, &resident_pages) != 2) {
+        return 0;
+    }
+    return (uint64_t)resident_pages * page_size;
+#else
+    return 0;
+#endif
+}
+
+/* Peak resident set size (VmHWM) of the process in bytes, 0 if unknown. */
+inline uint64_t peak_rss_bytes()
+{
+#if defined(__linux__)
+    FILE* p_file = std::fopen("/proc/self/status", "r");
+    if (p_file == nullptr) {
+        return 0;
+    }
+    char line[256];
+    unsigned long long peak_kb = 0;
+    while (std::fgets(line, sizeof(line), p_file) != nullptr) {
+        if (std::strncmp(line, "VmHWM:", 6) == 0) {
+            std::sscanf(line + 6, "%llu", &peak_kb);
+            break;
+        }
+    }
+    std::fclose(p_file);
+    return (uint64_t)peak_kb * 1024;
+#else
+    return 0;
+#endif
+}
+
+/*
+ *  \brief  Resets VmHWM to the current RSS through /proc/self/clear_refs.
+ *          Returns false if the kernel does not allow it.
+ */
+inline bool reset_peak_rss()
+{
+#if defined(__linux__)
+    const int fd = ::open("/proc/self/clear_refs", O_WRONLY);
+    if (fd == -1) {
+        return false;
+    }
+    const bool is_written = (::write(fd, "5", 1) == 1);
+    ::close(fd);
+    return is_written;
+#else
+    return false;
+#endif
+}
+
+struct memory_sample
+{
+    double time_ms = 0.0;
+    uint64_t rss_bytes = 0;
+    /* CPU time of the process over the sample period, in percents of one CPU. */
+    double cpu_pct = 0.0;
+};
+
+/*
+ *  \brief  Background thread which samples RSS and CPU usage of the process
+ *          with a fixed period. It tracks the peak RSS where VmHWM can not be
+ *          reset and records the time series if requested.
+ */
+class memory_sampler final
+{
+public:
+    memory_sampler() = default;
+    memory_sampler(const memory_sampler&) = delete;
+    memory_sampler& operator=(const memory_sampler&) = delete;
+
+    ~memory_sampler() { stop(); }
+
+    void start(size_t period_ms, bool is_series)
+    {
+        stop();
+        m_samples.clear();
+        m_peak_rss = rss_bytes();
+        m_is_stop = false;
+        m_is_series = is_series;
+        m_thread = std::thread([this, period_ms]() { run(period_ms); });
+    }
+
+    void stop()
+    {
+        if (! m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    uint64_t peak_rss() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::max(m_peak_rss, rss_bytes());
+    }
+
+    /* Valid after stop(). */
+    const std::vector<memory_sample>& samples() const { return m_samples; }
+
+private:
+    void run(size_t period_ms)
+    {
+        using clock = std::chrono::steady_clock;
+
+        unbind_thread();
+        const clock::time_point start_time = clock::now();
+        clock::time_point prev_time = start_time;
+        uint64_t prev_cpu_ns = process_cpu_time_ns();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (! m_cv.wait_for(lock, std::chrono::milliseconds(period_ms), [this] { return m_is_stop; })) {
+            const uint64_t rss = rss_bytes();
+            m_peak_rss = std::max(m_peak_rss, rss);
+            if (! m_is_series) {
+                continue;
+            }
+
+            const clock::time_point now = clock::now();
+            const uint64_t cpu_ns = process_cpu_time_ns();
+            const double wall_ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - prev_time).count();
+            memory_sample sample;
+            sample.time_ms = std::chrono::duration<double, std::milli>(now - start_time).count();
+            sample.rss_bytes = rss;
+            sample.cpu_pct = (wall_ns > 0.0) ? 100.0 * (double)(cpu_ns - prev_cpu_ns) / wall_ns : 0.0;
+            m_samples.emplace_back(sample);
+            prev_time = now;
+            prev_cpu_ns = cpu_ns;
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    bool m_is_stop = false;
+    bool m_is_series = false;
+    uint64_t m_peak_rss = 0;
+    std::vector<memory_sample> m_samples;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_MEMORY_USAGE_H */
@@ -0,0 +1,355 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_OPTIONS_H
+#define _TESTING_OPTIONS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "testing/details/clock.h"
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/perf_events.h"
+#include "testing/details/timer.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Global run options, set from the command line.
+ *
+ *  Options are passed as '--name=value'. Unknown options are reported and
+ *  ignored, so the test binary may share the command line with the tested
+ *  code.
+ */
+class options final
+{
+    struct flag
+    {
+        std::string name;
+        std::string value_descr;
+        std::string descr;
+        std::function<bool(const std::string&)> parse;
+    };
+
+public:
+    static options& get_instance()
+    {
+        static options instance;
+        return instance;
+    }
+
+    bool parse(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--help") {
+                is_help = true;
+                print_help();
+                continue;
+            }
+            if (arg.rfind("--", 0) != 0) {
+                continue;
+            }
+
+            const size_t eq_pos = arg.find('=');
+            const std::string name = arg.substr(2, eq_pos - 2);
+            const std::string value = (eq_pos == std::string::npos) ? "" : arg.substr(eq_pos + 1);
+
+            const flag* p_flag = find_flag(name);
+            if (p_flag == nullptr) {
+                std::cerr << "[ WARNING  ] Unknown option '" << arg << "'" << std::endl;
+                continue;
+            }
+            if (! p_flag->parse(value)) {
+                std::cerr << "[  ERROR   ] Invalid value of option '" << arg << "'" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    bool is_help = false;
+    size_t jobs = 1;
+    bool is_fork = false;
+    size_t shard_index = 0;
+    size_t total_shards = 1;
+    std::string shard_status_file;
+    std::string filter = "*";
+    bool is_list = false;
+    size_t repeat = 1;
+    bool is_break_on_failure = false;
+    size_t timeout_ms = 10 * 60 * 1000;
+    size_t global_timeout_ms = 0;
+    bool is_shuffle = false;
+    bool is_seed_set = false;
+    /* Seed without --seed and --shuffle, so the runs are reproducible. */
+    static constexpr uint32_t default_seed = 1;
+    /* Seed of the current repetition of the tests, see testing::GetRandomSeed(). */
+    uint32_t random_seed = default_seed;
+
+    clock_type perf_clock = clock_type::steady;
+    overhead_type perf_overhead = overhead_type::min;
+    size_t perf_samples = 10000;
+    bool perf_histogram = false;
+    size_t perf_min_time_ms = 500;
+    size_t perf_warmups = 0;
+    size_t perf_repetitions = 1;
+    double perf_max_cv = 5.0;
+    perf_events_mode perf_events = perf_events_mode::off;
+    bool perf_cpu_time = false;
+    bool perf_cpu_tracking = false;
+    bool perf_resources = false;
+    size_t perf_heap_profile = 0;
+    size_t perf_heap_top = 10;
+    size_t perf_memory_series_ms = 0;
+    size_t perf_max_threads = 0;
+    std::string perf_results;
+    /* Runner on the first CPU, the thread i of a multithreaded test on the CPU i modulo the size. */
+    std::vector<int> perf_cpus;
+    /* CPUs of the runner and of all threads, the scheduler places them among. */
+    std::vector<int> perf_cpuset;
+    bool perf_fifo = false;
+    bool perf_mlock = false;
+
+private:
+    options()
+    {
+        add_flag("filter", "GLOB[:GLOB][:-GLOB[:GLOB]]",
+                 "Run only the tests 'suite.test' matched by a glob and by none of the ones after '-'.",
+                 [this](const std::string& v) { filter = v; return true; });
+        add_flag("list", "",
+                 "List the tests passing the filter and the shard, without running them.",
+                 [this](const std::string& v) { return parse_bool(v, is_list); });
+        add_flag("repeat", "N",
+                 "Run the tests N times.",
+                 [this](const std::string& v) { return parse_size(v, repeat); });
+        add_flag("break_on_failure", "",
+                 "Raise SIGTRAP on a failure, so a debugger stops at the failed check.",
+                 [this](const std::string& v) { return parse_bool(v, is_break_on_failure); });
+        add_flag("timeout_ms", "N",
+                 "Time limit of a test unless it sets its own, 0 disables it.",
+                 [this](const std::string& v) { return parse_size(v, timeout_ms); });
+        add_flag("global_timeout_ms", "N",
+                 "Time limit of the whole run, 0 disables it.",
+                 [this](const std::string& v) { return parse_size(v, global_timeout_ms); });
+        add_flag("shuffle", "",
+                 "Run the suites and the tests of every suite in a random order.",
+                 [this](const std::string& v) { return parse_bool(v, is_shuffle); });
+        add_flag("seed", "N",
+                 "Seed of the shuffle and of the tests, random with --shuffle, fixed otherwise.",
+                 [this](const std::string& v) { return parse_seed(v); });
+        add_flag("jobs", "N",
+                 "Run the tests on N threads, 0 is the CPU count. Serial and perf tests run afterwards.",
+                 [this](const std::string& v) { return parse_size(v, jobs); });
+        add_flag("fork", "",
+                 "Run every test in one of --jobs forked processes, a crash fails only its test.",
+                 [this](const std::string& v) { return parse_bool(v, is_fork); });
+        add_flag("shard", "I/N",
+                 "Run the shard I of N, by default TEST_SHARD_INDEX of TEST_TOTAL_SHARDS.",
+                 [this](const std::string& v) { return parse_shard(v); });
+        add_flag("shard_status_file", "PATH",
+                 "Write the result of the shard to PATH, by default TEST_SHARD_STATUS_FILE.",
+                 [this](const std::string& v) { shard_status_file = v; return ! v.empty(); });
+        parse_env("TEST_TOTAL_SHARDS", total_shards);
+        parse_env("TEST_SHARD_INDEX", shard_index);
+        if (const char* p_path = std::getenv("TEST_SHARD_STATUS_FILE")) {
+            shard_status_file = p_path;
+        }
+        add_flag("perf_clock", "steady|monotonic_raw|thread_cpu|tsc",
+                 "Clock of the perf timers, unless a test selects its own.",
+                 [this](const std::string& v) { return parse_clock_type(v, perf_clock); });
+        add_flag("perf_overhead", "min|median|none",
+                 "Per interval timer overhead subtracted from the corrected time.",
+                 [this](const std::string& v) { return parse_overhead(v); });
+        add_flag("perf_samples", "N",
+                 "Intervals per perf timer recorded for the statistics, 0 disables.",
+                 [this](const std::string& v) { return parse_size(v, perf_samples); });
+        add_flag("perf_histogram", "",
+                 "Record the intervals of all perf timers into histograms.",
+                 [this](const std::string& v) { return parse_bool(v, perf_histogram); });
+        add_flag("perf_min_time_ms", "N",
+                 "Minimal measured time of a PERF_BENCHMARK run.",
+                 [this](const std::string& v) { return parse_size(v, perf_min_time_ms); });
+        add_flag("perf_warmups", "N",
+                 "Discarded runs of every perf test before the measured ones.",
+                 [this](const std::string& v) { return parse_size(v, perf_warmups); });
+        add_flag("perf_repetitions", "N",
+                 "Measured runs of every perf test.",
+                 [this](const std::string& v) { return parse_size(v, perf_repetitions); });
+        add_flag("perf_max_cv", "PERCENT",
+                 "Warn about timers whose variation across repetitions is higher.",
+                 [this](const std::string& v) { return parse_double(v, perf_max_cv); });
+        add_flag("perf_events", "off|hw|sw|instructions",
+                 "perf_event_open counters accumulated by every perf timer.",
+                 [this](const std::string& v) { return parse_perf_events_mode(v, perf_events); });
+        add_flag("perf_cpu_time", "",
+                 "Report the thread CPU time of every perf timer next to the wall time.",
+                 [this](const std::string& v) { return parse_bool(v, perf_cpu_time); });
+        add_flag("perf_cpu_tracking", "",
+                 "Report the CPUs of every perf timer and warn about migrations, a getcpu per start/pause.",
+                 [this](const std::string& v) { return parse_bool(v, perf_cpu_tracking); });
+        add_flag("perf_resources", "",
+                 "Report page faults, context switches and I/O of every perf timer.",
+                 [this](const std::string& v) { return parse_bool(v, perf_resources); });
+        add_flag("perf_heap_profile", "BYTES",
+                 "Sample an allocation call site every BYTES allocated on average, 0 disables.",
+                 [this](const std::string& v) { return parse_size(v, perf_heap_profile); });
+        add_flag("perf_heap_top", "N",
+                 "Call sites printed by the heap profile of every perf test.",
+                 [this](const std::string& v) { return parse_size(v, perf_heap_top); });
+        add_flag("perf_memory_series_ms", "N",
+                 "Sample RSS and CPU usage every N msecs of a perf test, 0 disables.",
+                 [this](const std::string& v) { return parse_size(v, perf_memory_series_ms); });
+        add_flag("perf_max_threads", "N",
+                 "Largest thread count of the multithreaded perf test sweeps, 0 is the CPU count.",
+                 [this](const std::string& v) { return parse_size(v, perf_max_threads); });
+        add_flag("perf_cpus", "LIST",
+                 "Pin the perf tests to the first CPU of LIST, e.g. 0,2-3, and their threads round robin.",
+                 [this](const std::string& v) { return parse_cpu_list(v, perf_cpus); });
+        add_flag("perf_cpuset", "LIST",
+                 "Run the perf tests and their threads on the CPUs of LIST.",
+                 [this](const std::string& v) { return parse_cpu_list(v, perf_cpuset); });
+        add_flag("perf_fifo", "",
+                 "Run the perf tests with the SCHED_FIFO policy, if permitted.",
+                 [this](const std::string& v) { return parse_bool(v, perf_fifo); });
+        add_flag("perf_mlock", "",
+                 "Lock the memory of the process with mlockall before the perf tests, if permitted.",
+                 [this](const std::string& v) { return parse_bool(v, perf_mlock); });
+        add_flag("perf_results", "PATH",
+                 "Append the results of every perf test to PATH as JSON lines.",
+                 [this](const std::string& v) { perf_results = v; return ! v.empty(); });
+    }
+
+    void add_flag(const std::string& name, const std::string& value_descr,
+                  const std::string& descr, std::function<bool(const std::string&)> parse_fn)
+    {
+        m_flags.push_back(flag{name, value_descr, descr, std::move(parse_fn)});
+    }
+
+    static bool parse_bool(const std::string& value, bool& res)
+    {
+        if (value.empty() || value == "1" || value == "true") {
+            res = true;
+        } else if (value == "0" || value == "false") {
+            res = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static bool parse_size(const std::string& value, size_t& res)
+    {
+        if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+        res = std::stoull(value);
+        return true;
+    }
+
+    static bool parse_double(const std::string& value, double& res)
+    {
+        char* p_end = nullptr;
+        res = std::strtod(value.c_str(), &p_end);
+        return ! value.empty() && *p_end == '\0';
+    }
+
+    static void parse_env(const char* name, size_t& res)
+    {
+        const char* p_value = std::getenv(name);
+        if (p_value != nullptr && ! parse_size(p_value, res)) {
+            std::cerr << "[ WARNING  ] Invalid value of " << name << "='" << p_value << "'" << std::endl;
+        }
+    }
+
+    bool parse_seed(const std::string& value)
+    {
+        size_t seed = 0;
+        if (! parse_size(value, seed) || seed > UINT32_MAX) {
+            return false;
+        }
+        random_seed = (uint32_t)seed;
+        is_seed_set = true;
+        return true;
+    }
+
+    bool parse_shard(const std::string& value)
+    {
+        const size_t slash_pos = value.find('/');
+        return slash_pos != std::string::npos
+            && parse_size(value.substr(0, slash_pos), shard_index)
+            && parse_size(value.substr(slash_pos + 1), total_shards);
+    }
+
+    bool parse_overhead(const std::string& value)
+    {
+        if (value == "median") {
+            perf_overhead = overhead_type::median;
+        } else if (value == "min") {
+            perf_overhead = overhead_type::min;
+        } else if (value == "none") {
+            perf_overhead = overhead_type::none;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    const flag* find_flag(const std::string& name) const
+    {
+        for (const flag& f : m_flags) {
+            if (f.name == name) {
+                return &f;
+            }
+        }
+        return nullptr;
+    }
+
+    void print_help() const
+    {
+        std::cout << "Options:" << std::endl;
+        for (const flag& f : m_flags) {
+            std::cout << "  --" << f.name;
+            if (! f.value_descr.empty()) {
+                std::cout << "=" << f.value_descr;
+            }
+            std::cout << std::endl << "      " << f.descr << std::endl;
+        }
+    }
+
+private:
+    std::vector<flag> m_flags;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_OPTIONS_H */
+
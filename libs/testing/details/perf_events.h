@@ -0,0 +1,310 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_PERF_EVENTS_H
+#define _TESTING_PERF_EVENTS_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace testing {
+namespace details {
+
+enum class perf_events_mode
+{
+    off,
+    hw,             /* Hardware events, software ones if the PMU is unavailable. */
+    sw,             /* Software events only. */
+    instructions    /* Retired user instructions only, for low noise gating. */
+};
+
+inline bool parse_perf_events_mode(const std::string& name, perf_events_mode& mode)
+{
+    if (name == "off") {
+        mode = perf_events_mode::off;
+    } else if (name == "hw") {
+        mode = perf_events_mode::hw;
+    } else if (name == "sw") {
+        mode = perf_events_mode::sw;
+    } else if (name == "instructions") {
+        mode = perf_events_mode::instructions;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  \brief  Counters of perf_event_open(2) groups of the calling thread.
+ *
+ *  Hardware and software events are opened as separate groups, so a PMU
+ *  refusing a hardware event does not take the software ones down. Every
+ *  group is read with a single read(2).
+ */
+class perf_events final
+{
+public:
+    static constexpr size_t max_events = 12;
+
+    /* Raw counts of a read and the times of their groups. */
+    struct sample
+    {
+        uint64_t v[max_events] = {};
+        uint64_t enabled[max_events] = {};
+        uint64_t running[max_events] = {};
+    };
+
+    /* Counts accumulated over intervals, scaled for multiplexing. */
+    struct values
+    {
+        double v[max_events] = {};
+    };
+
+    perf_events() = default;
+    perf_events(const perf_events&) = delete;
+    perf_events& operator=(const perf_events&) = delete;
+
+    ~perf_events() { close(); }
+
+    bool open(perf_events_mode mode)
+    {
+        close();
+#if defined(__linux__)
+        static bool is_warned = false;
+        if (mode == perf_events_mode::instructions) {
+            open_group({{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS}});
+        } else if (mode == perf_events_mode::hw) {
+            const uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            open_group({{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                        {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                        {"L1-dcache-misses", PERF_TYPE_HW_CACHE, l1d_read_miss},
+                        {"LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}});
+            if (m_groups.empty() && ! is_warned) {
+                std::cerr << "[ WARNING  ] Hardware perf events are unavailable, "
+                          << "falling back to software events." << std::endl;
+                is_warned = true;
+            }
+        }
+        if (mode == perf_events_mode::hw || mode == perf_events_mode::sw) {
+            open_group({{"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+                        {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+                        {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+                        {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS}});
+        }
+        if (mode != perf_events_mode::off && m_groups.empty() && ! is_warned) {
+            std::cerr << "[ WARNING  ] perf_event_open failed: " << std::strerror(errno)
+                      << ", perf events are disabled." << std::endl;
+            is_warned = true;
+        }
+#else
+        (void)mode;
+#endif
+        calibrate();
+        return ! m_groups.empty();
+    }
+
+    void close()
+    {
+#if defined(__linux__)
+        for (int fd : m_fds) {
+            ::close(fd);
+        }
+#endif
+        m_fds.clear();
+        m_groups.clear();
+        m_names.clear();
+        m_overhead = values();
+    }
+
+    bool is_open() const { return ! m_groups.empty(); }
+
+    size_t size() const { return m_names.size(); }
+
+    const std::string& name(size_t idx) const { return m_names[idx]; }
+
+    /* Reads the current raw counts, with a single read(2) per group. */
+    void read(sample& res) const
+    {
+#if defined(__linux__)
+        size_t pos = 0;
+        for (const group& g : m_groups) {
+            /* nr, time_enabled, time_running, values[nr] */
+            uint64_t buffer[3 + max_events];
+            const ssize_t size = ::read(g.leader_fd, buffer, sizeof(buffer));
+            const bool is_valid = (size > 0) && (buffer[0] == g.count);
+            for (size_t i = 0; i < g.count; ++i, ++pos) {
+                res.v[pos] = is_valid ? buffer[3 + i] : 0;
+                res.enabled[pos] = is_valid ? buffer[1] : 0;
+                res.running[pos] = is_valid ? buffer[2] : 0;
+            }
+        }
+#else
+        (void)res;
+#endif
+    }
+
+    /*
+     *  \brief  Adds the counts between two reads to 'res'. The raw, enabled
+     *          and running deltas are taken first and the count is scaled
+     *          once, for the part of the interval the group was not scheduled
+     *          on the PMU. A failed read counts nothing.
+     */
+    void accumulate(const sample& start, const sample& end, values& res) const
+    {
+        for (size_t i = 0; i < size(); ++i) {
+            if (end.v[i] < start.v[i] || end.enabled[i] < start.enabled[i]
+                || end.running[i] < start.running[i]) {
+                continue;
+            }
+            const uint64_t enabled = end.enabled[i] - start.enabled[i];
+            const uint64_t running = end.running[i] - start.running[i];
+            double value = (double)(end.v[i] - start.v[i]);
+            if (running != 0 && running < enabled) {
+                value *= (double)enabled / (double)running;
+            }
+            res.v[i] += value;
+        }
+    }
+
+    /*
+     *  \brief  Counts of an interval around no code, the read(2) calls that
+     *          bracket every interval. Subtracted per interval like the
+     *          timer overhead.
+     */
+    const values& overhead() const { return m_overhead; }
+
+private:
+    struct event_descr
+    {
+        const char* name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+    struct group
+    {
+        int leader_fd;
+        size_t count;
+    };
+
+#if defined(__linux__)
+    void open_group(std::initializer_list<event_descr> events)
+    {
+        int leader_fd = -1;
+        std::vector<int> fds;
+        std::vector<std::string> names;
+        for (const event_descr& e : events) {
+            if (m_names.size() + names.size() >= max_events) {
+                break;
+            }
+
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = e.type;
+            attr.config = e.config;
+            attr.disabled = (leader_fd == -1) ? 1 : 0;
+            /* Context switches and migrations happen in the kernel, they count with it only. */
+            attr.exclude_kernel = (e.type == PERF_TYPE_SOFTWARE) ? 0 : 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+                             | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = (int)::syscall(SYS_perf_event_open, &attr, 0, -1, leader_fd, 0);
+            if (fd == -1 && errno == EACCES && attr.exclude_kernel == 0) {
+                /* perf_event_paranoid forbids kernel counts, the user part is better than none. */
+                attr.exclude_kernel = 1;
+                fd = (int)::syscall(SYS_perf_event_open, &attr, 0, -1, leader_fd, 0);
+            }
+            if (fd == -1) {
+                if (leader_fd == -1) {
+                    return;
+                }
+                /* Skip the event the PMU does not support. */
+                continue;
+            }
+            if (leader_fd == -1) {
+                leader_fd = fd;
+            }
+            fds.emplace_back(fd);
+            names.emplace_back(e.name);
+        }
+
+        ::ioctl(leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        m_groups.push_back(group{leader_fd, fds.size()});
+        m_fds.insert(m_fds.end(), fds.begin(), fds.end());
+        m_names.insert(m_names.end(), names.begin(), names.end());
+    }
+#endif
+
+    /* The minimum counts of back to back reads, per event. */
+    void calibrate()
+    {
+        const size_t samples_count = 100;
+        m_overhead = values();
+        for (size_t i = 0; i < size(); ++i) {
+            m_overhead.v[i] = -1.0;
+        }
+        for (size_t n = 0; n < samples_count; ++n) {
+            sample start;
+            sample end;
+            read(start);
+            read(end);
+            values cur;
+            accumulate(start, end, cur);
+            for (size_t i = 0; i < size(); ++i) {
+                if (m_overhead.v[i] < 0.0 || cur.v[i] < m_overhead.v[i]) {
+                    m_overhead.v[i] = cur.v[i];
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<group> m_groups;
+    std::vector<int> m_fds;
+    std::vector<std::string> m_names;
+    values m_overhead;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_PERF_EVENTS_H */
+
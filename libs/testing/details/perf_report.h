@@ -0,0 +1,665 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_PERF_REPORT_H
+#define _TESTING_PERF_REPORT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "testing/details/alloc_counters.h"
+#include "testing/details/counter_table.h"
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/histogram.h"
+#include "testing/details/memory_usage.h"
+#include "testing/details/resource_usage.h"
+#include "testing/details/stats.h"
+
+namespace testing {
+namespace details {
+
+struct timer_result
+{
+    std::string name;
+    size_t level = 0;
+    uint64_t ns = 0;
+    /* The raw time if the overhead correction is within its noise, see is_corrected. */
+    uint64_t corrected_ns = 0;
+    bool is_corrected = false;
+    uint64_t count = 0;
+    /* CPU time of the thread over the intervals, if the timer counted it. */
+    bool is_cpu_time = false;
+    uint64_t cpu_ns = 0;
+    /* Heap activity of the intervals, if testing/alloc_hooks.h is used. */
+    bool is_allocs = false;
+    alloc_counts allocs;
+    /* Faults, context switches and I/O of the intervals, if the timer counted them. */
+    bool is_resources = false;
+    bool has_io = false;
+    resource_usage resources;
+    /* Steady clock time of the first start and of the last pause, for the timers of threads. */
+    uint64_t span_begin_ns = 0;
+    uint64_t span_end_ns = 0;
+    /* CPUs of the intervals, unknown if first_cpu is negative. */
+    cpu_placement placement;
+    /* perf_event_open counters accumulated over the intervals. */
+    std::vector<std::pair<std::string, double>> events;
+    /* Statistics of the recorded intervals in nanoseconds. */
+    summary stats;
+    /* Histogram of the intervals in clock ticks, if the timer recorded one. */
+    std::shared_ptr<histogram> p_histogram;
+    double ns_per_tick = 1.0;
+};
+
+struct counter_result
+{
+    std::string name;
+    counter_kind kind = counter_kind::total;
+    double value = 0.0;
+    double derived = 0.0;
+    /* Position in perf_result::timers, or counter::main_timer for the benchmark. */
+    size_t timer_pos = counter::main_timer;
+};
+
+/*
+ *  \brief  Resident memory of the process over a run of a perf test.
+ */
+struct memory_result
+{
+    uint64_t rss_before = 0;
+    uint64_t rss_after = 0;
+    uint64_t peak_rss = 0;
+    /* VmHWM reset by clear_refs, otherwise the peak of the sampler thread. */
+    bool is_peak_exact = false;
+    std::vector<memory_sample> series;
+
+    int64_t rss_delta() const { return (int64_t)rss_after - (int64_t)rss_before; }
+};
+
+/*
+ *  \brief  Timer of a multithreaded section merged over its threads.
+ */
+struct thread_timer_result
+{
+    std::string name;
+    size_t level = 0;
+    /* Sums over the threads. */
+    uint64_t corrected_ns = 0;
+    uint64_t count = 0;
+    /* Corrected time of the fastest and of the slowest thread. */
+    uint64_t min_thread_ns = 0;
+    uint64_t max_thread_ns = 0;
+    size_t threads = 0;
+    /* From the first start to the last pause over all threads. */
+    uint64_t span_ns = 0;
+    /* Last CPU of every thread and the migrations summed over the threads. */
+    std::vector<int> cpus;
+    uint64_t migrations = 0;
+    /* Statistics of the merged histograms, if the timer recorded them. */
+    summary stats;
+};
+
+struct thread_counter_result
+{
+    std::string name;
+    /* Timer whose intervals the counter counts. */
+    std::string timer;
+    counter_kind kind = counter_kind::total;
+    double total = 0.0;
+    double min_thread = 0.0;
+    double max_thread = 0.0;
+};
+
+/*
+ *  \brief  Results of one multithreaded section of a perf test body.
+ */
+struct mt_result
+{
+    size_t threads = 0;
+    /* From the release of the start barrier to the join of the last thread. */
+    uint64_t wall_ns = 0;
+    std::vector<thread_timer_result> timers;
+    std::vector<thread_counter_result> counters;
+    /* Aggregate work per second of the timer counting it and what is counted as work. */
+    double throughput = 0.0;
+    uint64_t throughput_ns = 0;
+    std::string throughput_unit;
+};
+
+/*
+ *  \brief  Results of a single run of a perf test body.
+ */
+struct perf_result
+{
+    std::string clock;
+    uint64_t overhead_ns = 0;
+    uint64_t min_overhead_ns = 0;
+    uint64_t overhead_noise_ns = 0;
+    double cycle_ns = 0.0;
+    uint64_t bench_iterations = 0;
+    uint64_t bench_ns = 0;
+    std::vector<timer_result> timers;
+    std::vector<counter_result> counters;
+    memory_result memory;
+    /* Multithreaded sections, several for a sweep of the thread count. */
+    std::vector<mt_result> mt;
+
+    double bench_ns_per_op() const
+    {
+        return (bench_iterations != 0) ? (double)bench_ns / (double)bench_iterations : 0.0;
+    }
+};
+
+/*
+ *  \brief  Merges the results of the threads of a multithreaded section by
+ *          timer and counter name. The throughput counts the first rate
+ *          counter, else the intervals of the first nested timer, else the
+ *          thread bodies. It is divided by the span of the timer the work is
+ *          counted in, so the unmeasured setup of the threads is left out and
+ *          threads which did not overlap do not add up to a speedup.
+ */
+inline mt_result merge_thread_results(uint64_t wall_ns, const std::vector<perf_result>& threads)
+{
+    mt_result res;
+    res.threads = threads.size();
+    res.wall_ns = wall_ns;
+
+    std::vector<std::shared_ptr<histogram>> histograms;
+    std::vector<double> ns_per_tick;
+    std::vector<uint64_t> span_begin_ns;
+    std::vector<uint64_t> span_end_ns;
+    for (const perf_result& thread : threads) {
+        for (const timer_result& tr : thread.timers) {
+            size_t i = 0;
+            while (i < res.timers.size() && res.timers[i].name != tr.name) {
+                ++i;
+            }
+            if (i == res.timers.size()) {
+                res.timers.emplace_back();
+                res.timers.back().name = tr.name;
+                res.timers.back().level = tr.level;
+                res.timers.back().min_thread_ns = tr.corrected_ns;
+                histograms.emplace_back();
+                ns_per_tick.emplace_back(tr.ns_per_tick);
+                span_begin_ns.emplace_back(UINT64_MAX);
+                span_end_ns.emplace_back(0);
+            }
+            if (tr.span_end_ns != 0) {
+                span_begin_ns[i] = std::min(span_begin_ns[i], tr.span_begin_ns);
+                span_end_ns[i] = std::max(span_end_ns[i], tr.span_end_ns);
+            }
+            thread_timer_result& ttr = res.timers[i];
+            ttr.corrected_ns += tr.corrected_ns;
+            ttr.count += tr.count;
+            ttr.min_thread_ns = std::min(ttr.min_thread_ns, tr.corrected_ns);
+            ttr.max_thread_ns = std::max(ttr.max_thread_ns, tr.corrected_ns);
+            ++ttr.threads;
+            if (tr.placement.last_cpu >= 0) {
+                ttr.cpus.emplace_back(tr.placement.last_cpu);
+            }
+            ttr.migrations += tr.placement.migrations;
+            if (tr.p_histogram) {
+                if (! histograms[i]) {
+                    histograms[i] = std::make_shared<histogram>();
+                }
+                histograms[i]->merge(*tr.p_histogram);
+            }
+        }
+
+        for (const counter_result& cr : thread.counters) {
+            size_t i = 0;
+            while (i < res.counters.size() && res.counters[i].name != cr.name) {
+                ++i;
+            }
+            if (i == res.counters.size()) {
+                res.counters.emplace_back();
+                res.counters.back().name = cr.name;
+                if (cr.timer_pos < thread.timers.size()) {
+                    res.counters.back().timer = thread.timers[cr.timer_pos].name;
+                }
+                res.counters.back().kind = cr.kind;
+                res.counters.back().min_thread = cr.value;
+                res.counters.back().max_thread = cr.value;
+            }
+            thread_counter_result& tcr = res.counters[i];
+            tcr.total += cr.value;
+            tcr.min_thread = std::min(tcr.min_thread, cr.value);
+            tcr.max_thread = std::max(tcr.max_thread, cr.value);
+        }
+    }
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        if (histograms[i]) {
+            res.timers[i].stats = histograms[i]->summarize(ns_per_tick[i]);
+        }
+        res.timers[i].span_ns = (span_end_ns[i] > span_begin_ns[i]) ? span_end_ns[i] - span_begin_ns[i] : 0;
+    }
+
+    const auto span_of = [&res, wall_ns](const std::string& timer) -> uint64_t {
+        for (const thread_timer_result& ttr : res.timers) {
+            if (ttr.name == timer && ttr.span_ns != 0) {
+                return ttr.span_ns;
+            }
+        }
+        return wall_ns;
+    };
+
+    double work = (double)res.threads;
+    res.throughput_ns = wall_ns;
+    res.throughput_unit = "bodies/sec";
+    const auto is_rate = [](counter_kind kind) {
+        return kind == counter_kind::rate || kind == counter_kind::bytes || kind == counter_kind::items;
+    };
+    std::vector<thread_counter_result>::const_iterator it_counter =
+        std::find_if(res.counters.cbegin(), res.counters.cend(),
+                     [&is_rate](const thread_counter_result& c) { return is_rate(c.kind); });
+    std::vector<thread_timer_result>::const_iterator it_timer =
+        std::find_if(res.timers.cbegin(), res.timers.cend(),
+                     [](const thread_timer_result& t) { return t.level > 0; });
+    if (it_counter != res.counters.cend()) {
+        work = it_counter->total;
+        res.throughput_unit = it_counter->name + "/sec";
+        res.throughput_ns = span_of(it_counter->timer);
+    } else if (it_timer != res.timers.cend()) {
+        work = (double)it_timer->count;
+        res.throughput_unit = it_timer->name + " intervals/sec";
+        res.throughput_ns = span_of(it_timer->name);
+    }
+    const double sec = (double)res.throughput_ns / 1000000000.0;
+    res.throughput = (sec > 0.0) ? work / sec : 0.0;
+    return res;
+}
+
+inline void print_summary(const std::string& prefix, const summary& st, uint64_t count)
+{
+    if (st.count == 0) {
+        return;
+    }
+
+    std::cout << prefix << "intervals: " << st.count;
+    if (st.count < count) {
+        std::cout << " of " << count;
+    }
+    std::cout << ", min: " << st.min << ", max: " << st.max << ", mean: " << st.mean
+              << ", median: " << st.median << ", stddev: " << st.stddev
+              << ", p90: " << st.p90 << ", p99: " << st.p99 << ", p99.9: " << st.p999
+              << " nsecs" << std::endl;
+}
+
+inline std::string human_number(double value)
+{
+    static const char* suffixes[] = {"", " k", " M", " G", " T"};
+
+    size_t i = 0;
+    while (value >= 1000.0 && i + 1 < sizeof(suffixes) / sizeof(suffixes[0])) {
+        value /= 1000.0;
+        ++i;
+    }
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2) << value << suffixes[i];
+    return os.str();
+}
+
+inline std::string counter_unit(counter_kind kind)
+{
+    switch (kind) {
+    case counter_kind::per_iteration: return " per iteration";
+    case counter_kind::rate:          return "/sec";
+    case counter_kind::bytes:         return "B/sec";
+    case counter_kind::items:         return " items/sec";
+    default:                          return "";
+    }
+}
+
+inline void print_resources(const timer_result& tr, const std::string& shift)
+{
+    const resource_usage& ru = tr.resources;
+    std::cout << "[   PERF   ] " << shift << "faults: " << ru.minor_faults << " minor, "
+              << ru.major_faults << " major, context switches: " << ru.voluntary_switches
+              << " voluntary, " << ru.involuntary_switches << " involuntary" << std::endl;
+    if (tr.has_io) {
+        std::cout << "[   PERF   ] " << shift << "io: read " << ru.read_chars << " bytes in "
+                  << ru.read_syscalls << " syscalls, written " << ru.write_chars << " bytes in "
+                  << ru.write_syscalls << " syscalls, storage read " << ru.storage_read_bytes
+                  << " bytes, written " << ru.storage_write_bytes << " bytes" << std::endl;
+    }
+}
+
+/* Warns about migrations, which cool the caches and change the core of the timer. */
+inline void print_placement(const std::string& name, const cpu_placement& placement, const std::string& shift)
+{
+    if (placement.first_cpu < 0) {
+        return;
+    }
+
+    std::cout << "[   PERF   ] " << shift << "cpu: ";
+    if (placement.migrations == 0) {
+        std::cout << placement.first_cpu;
+    } else {
+        std::cout << "first " << placement.first_cpu << ", last " << placement.last_cpu;
+    }
+    std::cout << ", migrations: " << placement.migrations << std::endl;
+    if (placement.migrations != 0) {
+        std::cout << "[ WARNING  ] " << name << " migrated between CPUs " << placement.migrations
+                  << " times, pin the perf tests with --perf_cpus" << std::endl;
+    }
+}
+
+inline void print_events(const timer_result& tr, const std::string& shift)
+{
+    if (tr.events.empty()) {
+        return;
+    }
+
+    double cycles = 0.0;
+    double instructions = 0.0;
+    std::cout << "[   PERF   ] " << shift << "events:";
+    const char* sep = " ";
+    for (const std::pair<std::string, double>& e : tr.events) {
+        std::cout << sep << e.first << " " << human_number(e.second);
+        sep = ", ";
+        cycles = (e.first == "cycles") ? e.second : cycles;
+        instructions = (e.first == "instructions") ? e.second : instructions;
+    }
+    if (cycles != 0.0) {
+        std::cout << ", IPC " << std::fixed << std::setprecision(2) << instructions / cycles
+                  << std::defaultfloat << std::setprecision(6);
+    }
+    std::cout << std::endl;
+
+    if (tr.count > 1) {
+        std::cout << "[   PERF   ] " << shift << "events per interval:";
+        sep = " ";
+        for (const std::pair<std::string, double>& e : tr.events) {
+            std::cout << sep << e.first << " " << human_number(e.second / (double)tr.count);
+            sep = ", ";
+        }
+        std::cout << std::endl;
+    }
+}
+
+inline void print_counters(const perf_result& result, size_t timer_pos, const std::string& shift)
+{
+    for (const counter_result& c : result.counters) {
+        if (c.timer_pos != timer_pos) {
+            continue;
+        }
+        std::cout << "[   PERF   ] " << shift << c.name << ": " << c.value;
+        if (c.kind != counter_kind::total) {
+            std::cout << " (" << human_number(c.derived) << counter_unit(c.kind) << ")";
+        }
+        std::cout << std::endl;
+    }
+}
+
+/*
+ *  \brief  Warns when less than a CPU cycle is spent per iteration, which
+ *          usually means the measured code was eliminated by the compiler.
+ */
+inline void check_per_iteration(const std::string& name, double ns_per_iteration, double cycle_ns)
+{
+    if (ns_per_iteration < cycle_ns) {
+        std::cout << "[ WARNING  ] " << name << ": " << ns_per_iteration << " nsecs per iteration "
+                  << "is below one CPU cycle (" << cycle_ns << " nsecs), the measured code was "
+                  << "probably optimized away; use DoNotOptimize() or PERF_KEEP()." << std::endl;
+    }
+}
+
+/*
+ *  \brief  Prints the merged multithreaded sections and, for a sweep, the
+ *          scaling curve with the speedup and the parallel efficiency
+ *          relative to the section with the fewest threads.
+ */
+inline void print_mt_results(const std::vector<mt_result>& sections)
+{
+    for (const mt_result& mt : sections) {
+        std::cout << "[   PERF   ]   threads: " << mt.threads << ", wall time: "
+                  << (double)mt.wall_ns / 1000000.0 << " msecs, throughput: "
+                  << human_number(mt.throughput) << " " << mt.throughput_unit << std::endl;
+        for (const thread_timer_result& ttr : mt.timers) {
+            const std::string shift(2 * ttr.level + 4, ' ');
+            std::cout << "[   PERF   ] " << shift << ttr.name << " total: "
+                      << (double)ttr.corrected_ns / 1000000.0 << " msecs, calls: " << ttr.count
+                      << ", per thread min: " << (double)ttr.min_thread_ns / 1000000.0
+                      << " msecs, max: " << (double)ttr.max_thread_ns / 1000000.0 << " msecs";
+            if (ttr.threads != mt.threads) {
+                std::cout << ", in " << ttr.threads << " threads";
+            }
+            std::cout << std::endl;
+            if (! ttr.cpus.empty()) {
+                std::cout << "[   PERF   ] " << shift << "  cpus:";
+                for (int cpu : ttr.cpus) {
+                    std::cout << " " << cpu;
+                }
+                std::cout << ", migrations: " << ttr.migrations << std::endl;
+            }
+            print_summary("[   PERF   ] " + shift + "  ", ttr.stats, ttr.count);
+        }
+        for (const thread_counter_result& tcr : mt.counters) {
+            std::cout << "[   PERF   ]     " << tcr.name << " total: " << human_number(tcr.total)
+                      << ", per thread min: " << human_number(tcr.min_thread) << ", max: "
+                      << human_number(tcr.max_thread) << std::endl;
+        }
+    }
+
+    if (sections.size() < 2 || sections.front().throughput <= 0.0) {
+        return;
+    }
+    const mt_result& base = sections.front();
+    std::cout << "[   PERF   ]   scaling of " << base.throughput_unit << ":" << std::endl;
+    for (const mt_result& mt : sections) {
+        const double speedup = mt.throughput / base.throughput;
+        const double efficiency = speedup * (double)base.threads / (double)mt.threads;
+        std::cout << "[   PERF   ]     threads: " << std::setw(3) << mt.threads << ", throughput: "
+                  << std::setw(10) << human_number(mt.throughput) << ", speedup: " << std::fixed
+                  << std::setprecision(2) << speedup << ", efficiency: " << efficiency * 100.0 << "%"
+                  << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+inline void print_result(const perf_result& result)
+{
+    std::cout << "[   PERF   ]   clock: " << result.clock << ", timer overhead: "
+              << result.overhead_ns << " nsecs per interval, noise: " << result.overhead_noise_ns
+              << " nsecs" << std::endl;
+
+    const memory_result& mem = result.memory;
+    std::cout << "[   PERF   ]   rss before: " << (double)mem.rss_before / 1048576.0 << " MiB, after: "
+              << (double)mem.rss_after / 1048576.0 << " MiB, delta: "
+              << (double)mem.rss_delta() / 1048576.0 << " MiB, peak: "
+              << (double)mem.peak_rss / 1048576.0 << " MiB" << (mem.is_peak_exact ? "" : " (sampled)");
+    if (! mem.series.empty()) {
+        std::cout << ", series: " << mem.series.size() << " samples";
+    }
+    std::cout << std::endl;
+
+    if (result.bench_iterations != 0) {
+        const double ns_per_op = result.bench_ns_per_op();
+        std::cout << "[   PERF   ]   benchmark: " << result.bench_iterations << " iterations, "
+                  << ns_per_op << " nsecs/op, "
+                  << ((ns_per_op > 0.0) ? 1000000000.0 / ns_per_op : 0.0) << " ops/sec" << std::endl;
+        check_per_iteration("benchmark", ns_per_op, result.cycle_ns);
+        print_counters(result, counter::main_timer, "    ");
+    }
+
+    for (size_t i = 0; i < result.timers.size(); ++i) {
+        const timer_result& tr = result.timers[i];
+        const std::string shift(2 * tr.level + 2, ' ');
+        std::cout << "[   PERF   ] " << shift << tr.name << " time: " << (double)tr.ns / 1000000.0
+                  << " msecs (";
+        if (tr.is_corrected || result.overhead_ns == 0) {
+            std::cout << "corrected: " << (double)tr.corrected_ns / 1000000.0 << " msecs";
+        } else {
+            std::cout << "within the overhead noise, not corrected";
+        }
+        std::cout << "), calls: " << tr.count << std::endl;
+        print_placement(tr.name, tr.placement, shift + "  ");
+        if (tr.is_cpu_time) {
+            const uint64_t wall_ns = tr.corrected_ns;
+            const uint64_t off_cpu_ns = (wall_ns > tr.cpu_ns) ? wall_ns - tr.cpu_ns : 0;
+            std::cout << "[   PERF   ] " << shift << "  cpu time: " << (double)tr.cpu_ns / 1000000.0
+                      << " msecs (" << ((wall_ns != 0) ? 100.0 * (double)tr.cpu_ns / (double)wall_ns : 0.0)
+                      << "% of wall time), off-cpu: " << (double)off_cpu_ns / 1000000.0 << " msecs"
+                      << std::endl;
+        }
+        if (tr.is_allocs) {
+            std::cout << "[   PERF   ] " << shift << "  allocs: " << tr.allocs.allocs << " ("
+                      << tr.allocs.bytes << " bytes), frees: " << tr.allocs.frees << ", live: "
+                      << tr.allocs.live_bytes() << " bytes" << std::endl;
+        }
+        if (tr.is_resources) {
+            print_resources(tr, shift + "  ");
+        }
+        print_summary("[   PERF   ] " + shift + "  ", tr.stats, tr.count);
+        if (tr.p_histogram) {
+            tr.p_histogram->print(std::cout, "[   PERF   ] " + shift + "    ", tr.ns_per_tick);
+        }
+        if (tr.count != 0 && result.overhead_ns != 0) {
+            /* The raw time above the fastest empty interval, suspicious only within the overhead noise. */
+            const double excess_ns = (double)tr.ns / (double)tr.count - (double)result.min_overhead_ns;
+            if (excess_ns <= (double)result.overhead_noise_ns) {
+                check_per_iteration(tr.name, excess_ns, result.cycle_ns);
+            }
+        }
+        print_events(tr, shift + "  ");
+        print_counters(result, i, shift + "  ");
+    }
+
+    print_mt_results(result.mt);
+}
+
+/*
+ *  \brief  Prints mean/median/stddev/CV of every timer across the measured
+ *          repetitions and warns about timers with CV above 'max_cv_pct'.
+ */
+inline void print_repetitions(const std::vector<perf_result>& results, double max_cv_pct)
+{
+    if (results.empty()) {
+        return;
+    }
+
+    std::cout << "[   PERF   ]   aggregates of " << results.size() << " repetitions:" << std::endl;
+
+    const auto print_aggregate = [max_cv_pct](const std::string& shift, const std::string& name,
+                                              const std::vector<double>& values, const std::string& unit,
+                                              bool is_check_cv = true) {
+        const summary st = summarize(values);
+        const double cv_pct = st.cv() * 100.0;
+        std::cout << "[   PERF   ] " << shift << name << " mean: " << st.mean << ", median: "
+                  << st.median << ", stddev: " << st.stddev << (unit.empty() ? "" : " ")
+                  << unit << ", cv: " << cv_pct
+                  << "%" << std::endl;
+        if (is_check_cv && cv_pct > max_cv_pct) {
+            std::cout << "[ WARNING  ] " << name << " is noisy: cv " << cv_pct << "% exceeds "
+                      << max_cv_pct << "%" << std::endl;
+        }
+    };
+
+    if (results.front().bench_iterations != 0) {
+        std::vector<double> values;
+        for (const perf_result& res : results) {
+            values.emplace_back(res.bench_ns_per_op());
+        }
+        print_aggregate("    ", "benchmark", values, "nsecs/op");
+    }
+
+    std::vector<double> peak_values;
+    for (const perf_result& res : results) {
+        peak_values.emplace_back((double)res.memory.peak_rss / 1048576.0);
+    }
+    print_aggregate("    ", "peak rss", peak_values, "MiB", false);
+
+    const std::vector<timer_result>& timers = results.front().timers;
+    for (size_t i = 0; i < timers.size(); ++i) {
+        std::vector<double> values;
+        std::shared_ptr<histogram> p_merged;
+        double ns_per_tick = 1.0;
+        for (const perf_result& res : results) {
+            if (i >= res.timers.size() || res.timers[i].name != timers[i].name) {
+                continue;
+            }
+            const timer_result& tr = res.timers[i];
+            values.emplace_back((double)tr.corrected_ns / 1000000.0);
+            if (tr.p_histogram) {
+                if (! p_merged) {
+                    p_merged = std::make_shared<histogram>();
+                }
+                p_merged->merge(*tr.p_histogram);
+                ns_per_tick = tr.ns_per_tick;
+            }
+        }
+
+        const std::string shift(2 * timers[i].level + 4, ' ');
+        print_aggregate(shift, timers[i].name, values, "msecs");
+        if (p_merged) {
+            print_summary("[   PERF   ] " + shift + "  merged ", p_merged->summarize(ns_per_tick),
+                          p_merged->count());
+        }
+
+        if (timers[i].is_cpu_time) {
+            std::vector<double> cpu_values;
+            for (const perf_result& res : results) {
+                if (i < res.timers.size() && res.timers[i].is_cpu_time) {
+                    cpu_values.emplace_back((double)res.timers[i].cpu_ns / 1000000.0);
+                }
+            }
+            print_aggregate(shift + "  ", timers[i].name + " cpu time", cpu_values, "msecs", false);
+        }
+
+        for (size_t j = 0; j < timers[i].events.size(); ++j) {
+            std::vector<double> event_values;
+            for (const perf_result& res : results) {
+                if (i < res.timers.size() && j < res.timers[i].events.size()) {
+                    event_values.emplace_back(res.timers[i].events[j].second);
+                }
+            }
+            print_aggregate(shift + "  ", timers[i].name + " " + timers[i].events[j].first,
+                            event_values, "", false);
+        }
+    }
+
+    const std::vector<counter_result>& counters = results.front().counters;
+    for (size_t i = 0; i < counters.size(); ++i) {
+        std::vector<double> values;
+        for (const perf_result& res : results) {
+            if (i < res.counters.size() && res.counters[i].name == counters[i].name) {
+                values.emplace_back(res.counters[i].derived);
+            }
+        }
+        std::string unit = counter_unit(counters[i].kind);
+        unit.erase(0, unit.find_first_not_of(' '));
+        print_aggregate("    ", counters[i].name, values, unit);
+    }
+}
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_PERF_REPORT_H */
+
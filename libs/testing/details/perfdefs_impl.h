@@ -42,6 +42,15 @@
 #define __FATAL_PERF_MESSAGE(cond)                           \
     ::testing::details::report_helper() = __PERF_FATAL_MESSAGE_IMPL(cond)
 
+#define __PERF_FAILURE_MESSAGE_IMPL(cond)                       \
+    ::testing::details::fail()                                  \
+        << __FILE__ << ":" << __LINE__ << ":" << std::endl      \
+        << "    " << __PRETTY_FUNCTION__ << ":" << std::endl    \
+        << "Failure condition '" << #cond << "'" << std::endl
+
+#define __PERF_FAILURE_MESSAGE(cond)                            \
+    ::testing::details::report_helper() = __PERF_FAILURE_MESSAGE_IMPL(cond)
+
 /*
  */
 
@@ -59,23 +68,82 @@
 #define __PERF_TYPE_PARAMS(suite_name)              \
     __test_type_##suite_name##_perf_param
 
+#define __PERF_ATTRS_RES(case_name, test_name)      \
+    __##case_name##_##test_name##_perf_attrs
+
+/*
+ *  \brief  Handle of a registered timer. The index is cached per call site
+ *          and thread, the name is looked up only on the first use in a
+ *          table, so a timer initialized in SetUp() can be used in the body.
+ */
+#define __PERF_SW_HANDLE(sw_name)                                               \
+    this->__cached_sw([]() -> ::testing::details::timer_table::handle_cache& {  \
+        static thread_local ::testing::details::timer_table::handle_cache cache; \
+        return cache;                                                           \
+    }(), #sw_name)
+
 /*
  */
 
 #define __PERF_INIT_HIERARCHY_TIMER(lvl, sw_name)                   \
-    this->__register_sw(lvl, #sw_name, std::move(::testing::details::timer()))
+    this->__register_sw(lvl, #sw_name)
+
+#define __PERF_INIT_HISTOGRAM_TIMER(lvl, sw_name)                   \
+    this->__register_sw(lvl, #sw_name, true)
 
 #define __PERF_START_TIMER_IMPL(sw_name)                            \
-    this->__get_sw(#sw_name).start()
+    __PERF_SW_HANDLE(sw_name).start()
 
 #define __PERF_RESTART_TIMER_IMPL(sw_name)                          \
-    this->__get_sw(#sw_name).restart()
+    __PERF_SW_HANDLE(sw_name).restart()
 
 #define __PERF_PAUSE_TIMER_IMPL(sw_name)                            \
-    this->__get_sw(#sw_name).pause()
+    __PERF_SW_HANDLE(sw_name).pause()
+
+#define __PERF_EXPECT_MAX_RSS_IMPL(bytes)                                       \
+    if (this->__peak_rss_bytes() <= (uint64_t)(bytes)) ;                        \
+    else __PERF_FAILURE_MESSAGE(peak_rss <= bytes)                              \
+        << "peak rss " << this->__peak_rss_bytes() << " bytes exceeds " << (uint64_t)(bytes)
+
+#define __PERF_EXPECT_MAX_ALLOCS_IMPL(sw_name, n)                               \
+    if (! ::testing::details::is_alloc_hooks_installed())                       \
+        __PERF_FAILURE_MESSAGE(is_alloc_hooks_installed())                      \
+            << "allocations are not counted, include testing/alloc_hooks.h";    \
+    else if (__PERF_SW_HANDLE(sw_name).allocs().allocs <= (uint64_t)(n)) ;      \
+    else __PERF_FAILURE_MESSAGE(allocs(sw_name) <= n)                           \
+        << "timer '" #sw_name "' made " << __PERF_SW_HANDLE(sw_name).allocs().allocs \
+        << " allocations of " << __PERF_SW_HANDLE(sw_name).allocs().bytes << " bytes"
 
 #define __PERF_TIMER_MSECS_IMPL(sw_name)                            \
-    this->__get_sw(#sw_name).value_ms()
+    __PERF_SW_HANDLE(sw_name).value_ms()
+
+#define __PERF_SET_TIMER_COUNTER_IMPL(sw_name, name, value, kind)    \
+    this->__add_counter(name, (double)(value),                      \
+                        ::testing::details::counter_kind::kind,     \
+                        __PERF_SW_HANDLE(sw_name).index())
+
+#define __PERF_SET_COUNTER_IMPL(name, value, kind)                  \
+    this->__add_counter(name, (double)(value),                      \
+                        ::testing::details::counter_kind::kind)
+
+#define __PERF_USE_CLOCK_IMPL(clock_name)                           \
+    this->__use_perf_clock(::testing::details::clock_type::clock_name)
+
+#define __PERF_SET_SAMPLES_LIMIT_IMPL(limit)                        \
+    this->__set_samples_limit(limit)
+
+#define __PERF_SET_MIN_TIME_MS_IMPL(ms)                             \
+    this->__set_min_time_ms(ms)
+
+/*
+ *  \brief  Implementation for PERF_TEST_ATTRS macro.
+ */
+
+#define __PERF_TEST_ATTRS_IMPL(case_name, test_name)                           \
+    [[maybe_unused]] static ::testing::details::test_attrs&                    \
+        __PERF_ATTRS_RES(case_name, test_name) =                               \
+            ::testing::details::tester::attrs(                                 \
+                __CVT_TO_STRING(case_name), __CVT_TO_STRING(test_name))
 
 /*
  *  \brief  Implementation for TEST macro.
@@ -91,9 +159,7 @@
         __PERF_CLASS_NAME(suite_name, test_name)() {}                          \
         static suite_ptr make_suite_ptr()                                      \
         {                                                                      \
-            std::shared_ptr<__PERF_CLASS_NAME(suite_name, test_name)> p_ =     \
-                std::make_shared<__PERF_CLASS_NAME(suite_name, test_name)>();  \
-            return std::make_shared<decorator>(p_);                            \
+            return std::make_shared<decorator>();                              \
         }                                                                      \
     private:                                                                   \
         virtual void test_body();                                              \
@@ -104,6 +170,69 @@
             __PERF_CLASS_NAME(suite_name, test_name)::make_suite_ptr());       \
     void __PERF_CLASS_NAME(suite_name, test_name)::test_body()
 
+/*
+ *  \brief  Implementation for PERF_BENCHMARK macro.
+ */
+
+#define __PERF_BENCHMARK_IMPL(suite_name, test_name)                           \
+    class __PERF_CLASS_NAME(suite_name, test_name) : public suite_name         \
+    {                                                                          \
+    public:                                                                    \
+        using decorator = ::testing::details::perf_decorator<                  \
+                    __PERF_CLASS_NAME(suite_name, test_name)>;                 \
+        using suite_ptr = ::testing::details::itest_suite::ptr;                \
+        __PERF_CLASS_NAME(suite_name, test_name)() {}                          \
+        static suite_ptr make_suite_ptr()                                      \
+        {                                                                      \
+            return std::make_shared<decorator>();                              \
+        }                                                                      \
+    private:                                                                   \
+        virtual void test_body()                                               \
+        {                                                                      \
+            this->__run_benchmark(                                             \
+                [this](::testing::details::benchmark_state& state) {           \
+                    benchmark_body(state);                                     \
+                });                                                            \
+        }                                                                      \
+        void benchmark_body(::testing::details::benchmark_state& state);       \
+    };                                                                         \
+    [[maybe_unused]] static bool __PERF_INSERT_RES(suite_name, test_name) =    \
+        ::testing::details::tester::insert(                                    \
+            __CVT_TO_STRING(suite_name), __CVT_TO_STRING(test_name),           \
+            __PERF_CLASS_NAME(suite_name, test_name)::make_suite_ptr());       \
+    void __PERF_CLASS_NAME(suite_name, test_name)::benchmark_body(             \
+        [[maybe_unused]] ::testing::details::benchmark_state& state)
+
+#define __PERF_TEST_MT_IMPL(suite_name, test_name, threads)                    \
+    class __PERF_CLASS_NAME(suite_name, test_name) : public suite_name         \
+    {                                                                          \
+    public:                                                                    \
+        using decorator = ::testing::details::perf_decorator<                  \
+                    __PERF_CLASS_NAME(suite_name, test_name)>;                 \
+        using suite_ptr = ::testing::details::itest_suite::ptr;                \
+        __PERF_CLASS_NAME(suite_name, test_name)() {}                          \
+        static suite_ptr make_suite_ptr()                                      \
+        {                                                                      \
+            return std::make_shared<decorator>();                              \
+        }                                                                      \
+    private:                                                                   \
+        virtual void test_body()                                               \
+        {                                                                      \
+            this->__run_threads(threads,                                       \
+                [this](size_t thread_index, size_t thread_count) {             \
+                    mt_body(thread_index, thread_count);                       \
+                });                                                            \
+        }                                                                      \
+        void mt_body(size_t thread_index, size_t thread_count);                \
+    };                                                                         \
+    [[maybe_unused]] static bool __PERF_INSERT_RES(suite_name, test_name) =    \
+        ::testing::details::tester::insert(                                    \
+            __CVT_TO_STRING(suite_name), __CVT_TO_STRING(test_name),           \
+            __PERF_CLASS_NAME(suite_name, test_name)::make_suite_ptr());       \
+    void __PERF_CLASS_NAME(suite_name, test_name)::mt_body(                    \
+        [[maybe_unused]] size_t thread_index,                                  \
+        [[maybe_unused]] size_t thread_count)
+
 /*
  *  \brief  Implementation for TYPED_TEST macro.
  */
@@ -0,0 +1,318 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_PROCESS_POOL_H
+#define _TESTING_PROCESS_POOL_H
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "testing/details/watchdog.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Runs tasks in forked worker processes. The parent sends the task
+ *          indexes to the idle workers over pipes and the workers answer with
+ *          the result of every task. The stdout and stderr of a worker go to
+ *          a temporary file, which the parent reads once the task is done or
+ *          the worker died. A dead worker is replaced by a new one.
+ */
+class process_pool final
+{
+public:
+    struct result
+    {
+        bool is_failed = false;
+        /* Exit status or signal of a worker which died running the task. */
+        bool is_crashed = false;
+        int status = 0;
+        std::string output;
+    };
+
+    /* Runs the task in a worker and returns true if it failed. */
+    using run_fn = std::function<bool(size_t)>;
+    /* Takes the result of a task in the parent. */
+    using done_fn = std::function<void(size_t, const result&)>;
+
+    process_pool(size_t workers, run_fn run)
+        : m_workers(std::max<size_t>(1, workers))
+        , m_run(std::move(run))
+    {}
+
+    process_pool(const process_pool&) = delete;
+    process_pool& operator=(const process_pool&) = delete;
+
+    ~process_pool()
+    {
+        for (worker& w : m_workers) {
+            stop(w);
+            if (w.p_output != nullptr) {
+                std::fclose(w.p_output);
+            }
+        }
+    }
+
+    /* Runs the tasks, at most 'max_busy' of them at once. */
+    bool run(const std::vector<size_t>& tasks, size_t max_busy, const done_fn& done)
+    {
+        struct sigaction ignore_pipe = {};
+        struct sigaction prev_pipe = {};
+        ignore_pipe.sa_handler = SIG_IGN;
+        ::sigaction(SIGPIPE, &ignore_pipe, &prev_pipe);
+
+        bool is_ok = true;
+        size_t next = 0;
+        size_t busy = 0;
+        while (is_ok && (next < tasks.size() || busy > 0)) {
+            for (worker& w : m_workers) {
+                if (next == tasks.size() || busy == max_busy) {
+                    break;
+                }
+                if (! w.is_busy) {
+                    is_ok = is_ok && assign(w, tasks[next++]);
+                    busy += is_ok ? 1 : 0;
+                }
+            }
+            if (is_ok) {
+                busy -= wait_results(done);
+            }
+        }
+
+        ::sigaction(SIGPIPE, &prev_pipe, nullptr);
+        return is_ok;
+    }
+
+private:
+    struct worker
+    {
+        pid_t pid = -1;
+        int task_fd = -1;
+        int result_fd = -1;
+        std::FILE* p_output = nullptr;
+        bool is_busy = false;
+        size_t task = 0;
+    };
+
+    bool assign(worker& w, size_t task)
+    {
+        if (w.pid < 0 && ! spawn(w)) {
+            return false;
+        }
+
+        const int output_fd = ::fileno(w.p_output);
+        if (::ftruncate(output_fd, 0) != 0 || ::lseek(output_fd, 0, SEEK_SET) != 0) {
+            std::cerr << "[  ERROR   ] Failed to reset the worker output: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        const uint64_t value = task;
+        w.task = task;
+        w.is_busy = true;
+        /* A worker that died here is found by wait_results. */
+        write_all(w.task_fd, &value, sizeof(value));
+        return true;
+    }
+
+    size_t wait_results(const done_fn& done)
+    {
+        std::vector<pollfd> fds;
+        std::vector<worker*> busy;
+        for (worker& w : m_workers) {
+            if (w.is_busy) {
+                fds.push_back(pollfd{w.result_fd, POLLIN, 0});
+                busy.emplace_back(&w);
+            }
+        }
+        if (::poll(fds.data(), fds.size(), -1) < 0) {
+            return 0;
+        }
+
+        size_t finished = 0;
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            worker& w = *busy[i];
+            char is_failed = 0;
+            result res;
+            if (read_all(w.result_fd, &is_failed, sizeof(is_failed))) {
+                res.is_failed = (is_failed != 0);
+            } else {
+                res.is_failed = true;
+                res.is_crashed = true;
+                res.status = stop(w);
+            }
+            res.output = read_output(w);
+            w.is_busy = false;
+            ++finished;
+            done(w.task, res);
+        }
+        return finished;
+    }
+
+    bool spawn(worker& w)
+    {
+        if (w.p_output == nullptr) {
+            w.p_output = std::tmpfile();
+        }
+        int task_pipe[2] = {-1, -1};
+        int result_pipe[2] = {-1, -1};
+        if (w.p_output == nullptr || ::pipe(task_pipe) != 0 || ::pipe(result_pipe) != 0) {
+            std::cerr << "[  ERROR   ] Failed to create a worker: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        std::cout << std::flush;
+        std::cerr << std::flush;
+        std::fflush(nullptr);
+        const pid_t pid = ::fork();
+        if (pid < 0) {
+            std::cerr << "[  ERROR   ] Failed to fork a worker: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (pid == 0) {
+            watchdog::get_instance().after_fork();
+            ::close(task_pipe[1]);
+            ::close(result_pipe[0]);
+            for (worker& other : m_workers) {
+                close_fd(other.task_fd);
+                close_fd(other.result_fd);
+            }
+            ::dup2(::fileno(w.p_output), STDOUT_FILENO);
+            ::dup2(::fileno(w.p_output), STDERR_FILENO);
+            work(task_pipe[0], result_pipe[1]);
+        }
+
+        ::close(task_pipe[0]);
+        ::close(result_pipe[1]);
+        w.pid = pid;
+        w.task_fd = task_pipe[1];
+        w.result_fd = result_pipe[0];
+        return true;
+    }
+
+    [[noreturn]] void work(int task_fd, int result_fd)
+    {
+        uint64_t task = 0;
+        while (read_all(task_fd, &task, sizeof(task))) {
+            const char is_failed = m_run(task) ? 1 : 0;
+            std::cout << std::flush;
+            std::cerr << std::flush;
+            std::fflush(nullptr);
+            if (! write_all(result_fd, &is_failed, sizeof(is_failed))) {
+                break;
+            }
+        }
+        ::_exit(0);
+    }
+
+    /* Closes the pipes, so an idle worker exits, and returns its wait status. */
+    static int stop(worker& w)
+    {
+        close_fd(w.task_fd);
+        close_fd(w.result_fd);
+        int status = 0;
+        if (w.pid > 0) {
+            while (::waitpid(w.pid, &status, 0) < 0 && errno == EINTR) {}
+        }
+        w.pid = -1;
+        return status;
+    }
+
+    static std::string read_output(const worker& w)
+    {
+        std::string output;
+        char buf[4096];
+        ssize_t len = 0;
+        while ((len = ::pread(::fileno(w.p_output), buf, sizeof(buf), output.size())) > 0) {
+            output.append(buf, len);
+        }
+        return output;
+    }
+
+    static void close_fd(int& fd)
+    {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    static bool read_all(int fd, void* p_buf, size_t size)
+    {
+        char* p = static_cast<char*>(p_buf);
+        while (size > 0) {
+            const ssize_t len = ::read(fd, p, size);
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                return false;
+            }
+            p += len;
+            size -= len;
+        }
+        return true;
+    }
+
+    static bool write_all(int fd, const void* p_buf, size_t size)
+    {
+        const char* p = static_cast<const char*>(p_buf);
+        while (size > 0) {
+            const ssize_t len = ::write(fd, p, size);
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                return false;
+            }
+            p += len;
+            size -= len;
+        }
+        return true;
+    }
+
+private:
+    std::vector<worker> m_workers;
+    run_fn m_run;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_PROCESS_POOL_H */
@@ -0,0 +1,210 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_RESOURCE_USAGE_H
+#define _TESTING_RESOURCE_USAGE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__)
+    #include <fcntl.h>
+    #include <sys/resource.h>
+    #include <sys/time.h>
+    #include <unistd.h>
+#endif
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  OS resources consumed by a thread: page faults and context
+ *          switches of getrusage() and the I/O of /proc/thread-self/io.
+ */
+struct resource_usage
+{
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    /* Bytes passed to read/write like syscalls, including the page cache. */
+    uint64_t read_chars = 0;
+    uint64_t write_chars = 0;
+    uint64_t read_syscalls = 0;
+    uint64_t write_syscalls = 0;
+    /* Bytes fetched from or sent to the storage layer. */
+    uint64_t storage_read_bytes = 0;
+    uint64_t storage_write_bytes = 0;
+
+    resource_usage& operator+=(const resource_usage& other)
+    {
+        minor_faults += other.minor_faults;
+        major_faults += other.major_faults;
+        voluntary_switches += other.voluntary_switches;
+        involuntary_switches += other.involuntary_switches;
+        read_chars += other.read_chars;
+        write_chars += other.write_chars;
+        read_syscalls += other.read_syscalls;
+        write_syscalls += other.write_syscalls;
+        storage_read_bytes += other.storage_read_bytes;
+        storage_write_bytes += other.storage_write_bytes;
+        return *this;
+    }
+
+    resource_usage operator-(const resource_usage& other) const
+    {
+        resource_usage res;
+        res.minor_faults = minor_faults - other.minor_faults;
+        res.major_faults = major_faults - other.major_faults;
+        res.voluntary_switches = voluntary_switches - other.voluntary_switches;
+        res.involuntary_switches = involuntary_switches - other.involuntary_switches;
+        res.read_chars = read_chars - other.read_chars;
+        res.write_chars = write_chars - other.write_chars;
+        res.read_syscalls = read_syscalls - other.read_syscalls;
+        res.write_syscalls = write_syscalls - other.write_syscalls;
+        res.storage_read_bytes = storage_read_bytes - other.storage_read_bytes;
+        res.storage_write_bytes = storage_write_bytes - other.storage_write_bytes;
+        return res;
+    }
+};
+
+/*
+ *  \brief  Reader of the resource usage of the thread which opened it. The
+ *          I/O file is kept open and re-read with pread(), so a read costs
+ *          two syscalls without opening a file.
+ */
+class resource_reader final
+{
+public:
+    resource_reader() = default;
+    resource_reader(const resource_reader&) = delete;
+    resource_reader& operator=(const resource_reader&) = delete;
+
+    ~resource_reader() { close(); }
+
+    /* Must be called from the measured thread. */
+    bool open()
+    {
+        close();
+#if defined(__linux__)
+        m_io_fd = ::open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+#endif
+        m_is_open = true;
+        return true;
+    }
+
+    void close()
+    {
+#if defined(__unix__)
+        if (m_io_fd != -1) {
+            ::close(m_io_fd);
+        }
+#endif
+        m_io_fd = -1;
+        m_is_open = false;
+        m_self_chars = 0;
+        m_self_reads = 0;
+    }
+
+    bool is_open() const { return m_is_open; }
+
+    /* False if the I/O accounting is unavailable, e.g. without task I/O stats. */
+    bool has_io() const { return m_io_fd != -1; }
+
+    void read(resource_usage& res) const
+    {
+#if defined(__unix__)
+        struct ::rusage ru;
+    #if defined(RUSAGE_THREAD)
+        const int who = RUSAGE_THREAD;
+    #else
+        const int who = RUSAGE_SELF;
+    #endif
+        if (::getrusage(who, &ru) == 0) {
+            res.minor_faults = (uint64_t)ru.ru_minflt;
+            res.major_faults = (uint64_t)ru.ru_majflt;
+            res.voluntary_switches = (uint64_t)ru.ru_nvcsw;
+            res.involuntary_switches = (uint64_t)ru.ru_nivcsw;
+        }
+        if (m_io_fd != -1) {
+            read_io(res);
+        }
+#else
+        (void)res;
+#endif
+    }
+
+private:
+#if defined(__unix__)
+    void read_io(resource_usage& res) const
+    {
+        char buffer[512];
+        const ssize_t size = ::pread(m_io_fd, buffer, sizeof(buffer) - 1, 0);
+        if (size <= 0) {
+            return;
+        }
+        buffer[size] = 0x00;
+
+        struct field
+        {
+            const char* name;
+            uint64_t* p_value;
+        };
+        const field fields[] = {
+            {"rchar:", &res.read_chars}, {"wchar:", &res.write_chars},
+            {"syscr:", &res.read_syscalls}, {"syscw:", &res.write_syscalls},
+            {"read_bytes:", &res.storage_read_bytes}, {"write_bytes:", &res.storage_write_bytes}
+        };
+        for (char* p_line = buffer; p_line != nullptr && *p_line != 0x00; ) {
+            char* p_next = std::strchr(p_line, '\n');
+            for (const field& f : fields) {
+                const size_t len = std::strlen(f.name);
+                if (std::strncmp(p_line, f.name, len) == 0) {
+                    *f.p_value = std::strtoull(p_line + len, nullptr, 10);
+                    break;
+                }
+            }
+            p_line = (p_next != nullptr) ? p_next + 1 : nullptr;
+        }
+
+        /* The file shows the preceding reads of the reader itself, but not this one. */
+        res.read_chars -= m_self_chars;
+        res.read_syscalls -= m_self_reads;
+        m_self_chars += (uint64_t)size;
+        ++m_self_reads;
+    }
+#endif
+
+private:
+    int m_io_fd = -1;
+    bool m_is_open = false;
+    mutable uint64_t m_self_chars = 0;
+    mutable uint64_t m_self_reads = 0;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_RESOURCE_USAGE_H */
@@ -0,0 +1,276 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_RESULTS_FILE_H
+#define _TESTING_RESULTS_FILE_H
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "testing/details/machine_info.h"
+#include "testing/details/options.h"
+#include "testing/details/perf_report.h"
+
+namespace testing {
+namespace details {
+
+inline std::string json_string(const std::string& str)
+{
+    std::string res = "\"";
+    for (char c : str) {
+        switch (c) {
+        case '"':  res += "\\\""; break;
+        case '\\': res += "\\\\"; break;
+        case '\n': res += "\\n"; break;
+        case '\t': res += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned int)c);
+                res += buffer;
+            } else {
+                res += c;
+            }
+        }
+    }
+    return res + "\"";
+}
+
+inline const char* counter_kind_name(counter_kind kind)
+{
+    switch (kind) {
+    case counter_kind::per_iteration: return "per_iteration";
+    case counter_kind::rate:          return "rate";
+    case counter_kind::bytes:         return "bytes";
+    case counter_kind::items:         return "items";
+    default:                          return "total";
+    }
+}
+
+inline void write_json(std::ostream& os, const summary& st)
+{
+    os << "{\"count\":" << st.count << ",\"min\":" << st.min << ",\"max\":" << st.max
+       << ",\"mean\":" << st.mean << ",\"median\":" << st.median << ",\"stddev\":" << st.stddev
+       << ",\"p90\":" << st.p90 << ",\"p99\":" << st.p99 << ",\"p999\":" << st.p999 << "}";
+}
+
+inline void write_json(std::ostream& os, const timer_result& tr)
+{
+    os << "{\"name\":" << json_string(tr.name) << ",\"level\":" << tr.level << ",\"ns\":" << tr.ns
+       << ",\"corrected_ns\":" << tr.corrected_ns << ",\"is_corrected\":" << (tr.is_corrected ? "true" : "false")
+       << ",\"count\":" << tr.count << ",\"stats\":";
+    write_json(os, tr.stats);
+    if (tr.is_cpu_time) {
+        os << ",\"cpu_ns\":" << tr.cpu_ns;
+    }
+    if (tr.placement.first_cpu >= 0) {
+        os << ",\"cpu\":{\"first\":" << tr.placement.first_cpu << ",\"last\":" << tr.placement.last_cpu
+           << ",\"migrations\":" << tr.placement.migrations << "}";
+    }
+    if (tr.is_allocs) {
+        os << ",\"allocs\":{\"count\":" << tr.allocs.allocs << ",\"bytes\":" << tr.allocs.bytes
+           << ",\"frees\":" << tr.allocs.frees << ",\"live_bytes\":" << tr.allocs.live_bytes() << "}";
+    }
+    if (tr.is_resources) {
+        const resource_usage& ru = tr.resources;
+        os << ",\"resources\":{\"minor_faults\":" << ru.minor_faults << ",\"major_faults\":" << ru.major_faults
+           << ",\"voluntary_switches\":" << ru.voluntary_switches
+           << ",\"involuntary_switches\":" << ru.involuntary_switches;
+        if (tr.has_io) {
+            os << ",\"read_chars\":" << ru.read_chars << ",\"write_chars\":" << ru.write_chars
+               << ",\"read_syscalls\":" << ru.read_syscalls << ",\"write_syscalls\":" << ru.write_syscalls
+               << ",\"storage_read_bytes\":" << ru.storage_read_bytes
+               << ",\"storage_write_bytes\":" << ru.storage_write_bytes;
+        }
+        os << "}";
+    }
+    if (! tr.events.empty()) {
+        os << ",\"events\":{";
+        for (size_t i = 0; i < tr.events.size(); ++i) {
+            os << ((i == 0) ? "" : ",") << json_string(tr.events[i].first) << ":" << tr.events[i].second;
+        }
+        os << "}";
+    }
+    os << "}";
+}
+
+inline void write_json(std::ostream& os, const memory_result& mem)
+{
+    os << "{\"rss_before\":" << mem.rss_before << ",\"rss_after\":" << mem.rss_after
+       << ",\"peak_rss\":" << mem.peak_rss << ",\"is_peak_exact\":" << (mem.is_peak_exact ? "true" : "false")
+       << ",\"series\":[";
+    for (size_t i = 0; i < mem.series.size(); ++i) {
+        const memory_sample& sample = mem.series[i];
+        os << ((i == 0) ? "" : ",") << "{\"time_ms\":" << sample.time_ms << ",\"rss\":" << sample.rss_bytes
+           << ",\"cpu_pct\":" << sample.cpu_pct << "}";
+    }
+    os << "]}";
+}
+
+inline void write_json(std::ostream& os, const mt_result& mt)
+{
+    os << "{\"threads\":" << mt.threads << ",\"wall_ns\":" << mt.wall_ns << ",\"throughput\":"
+       << mt.throughput << ",\"throughput_unit\":" << json_string(mt.throughput_unit) << ",\"throughput_ns\":"
+       << mt.throughput_ns << ",\"timers\":[";
+    for (size_t i = 0; i < mt.timers.size(); ++i) {
+        const thread_timer_result& tr = mt.timers[i];
+        os << ((i == 0) ? "" : ",") << "{\"name\":" << json_string(tr.name) << ",\"level\":" << tr.level
+           << ",\"corrected_ns\":" << tr.corrected_ns << ",\"count\":" << tr.count
+           << ",\"min_thread_ns\":" << tr.min_thread_ns << ",\"max_thread_ns\":" << tr.max_thread_ns
+           << ",\"threads\":" << tr.threads << ",\"span_ns\":" << tr.span_ns << ",\"cpus\":[";
+        for (size_t j = 0; j < tr.cpus.size(); ++j) {
+            os << ((j == 0) ? "" : ",") << tr.cpus[j];
+        }
+        os << "],\"migrations\":" << tr.migrations << ",\"stats\":";
+        write_json(os, tr.stats);
+        os << "}";
+    }
+    os << "],\"counters\":[";
+    for (size_t i = 0; i < mt.counters.size(); ++i) {
+        const thread_counter_result& c = mt.counters[i];
+        os << ((i == 0) ? "" : ",") << "{\"name\":" << json_string(c.name) << ",\"kind\":\""
+           << counter_kind_name(c.kind) << "\",\"total\":" << c.total << ",\"min_thread\":"
+           << c.min_thread << ",\"max_thread\":" << c.max_thread << "}";
+    }
+    os << "]}";
+}
+
+inline void write_json(std::ostream& os, const machine_info& info)
+{
+    os << "{\"cpu_model\":" << json_string(info.cpu_model) << ",\"logical_cpus\":" << info.logical_cpus
+       << ",\"cores\":" << info.cores << ",\"sockets\":" << info.sockets << ",\"smt\":"
+       << (info.is_smt ? "true" : "false") << ",\"caches\":[";
+    for (size_t i = 0; i < info.caches.size(); ++i) {
+        const cache_info& c = info.caches[i];
+        os << ((i == 0) ? "" : ",") << "{\"level\":" << c.level << ",\"type\":" << json_string(c.type)
+           << ",\"size\":" << json_string(c.size) << "}";
+    }
+    os << "],\"cpu\":" << info.cpu << ",\"governor\":" << json_string(info.governor)
+       << ",\"cur_freq_khz\":" << info.cur_freq_khz << ",\"max_freq_khz\":" << info.max_freq_khz
+       << ",\"turbo\":" << json_string(info.turbo) << ",\"load_avg\":[" << info.load_avg[0] << ","
+       << info.load_avg[1] << "," << info.load_avg[2] << "],\"thp\":" << json_string(info.thp)
+       << ",\"kernel\":" << json_string(info.kernel) << ",\"jitter\":{\"wakeup_median_ns\":"
+       << info.wakeup_median_ns << ",\"wakeup_max_ns\":" << info.wakeup_max_ns << ",\"max_gap_ns\":"
+       << info.max_gap_ns << "},\"warnings\":[";
+    for (size_t i = 0; i < info.warnings.size(); ++i) {
+        os << ((i == 0) ? "" : ",") << json_string(info.warnings[i]);
+    }
+    os << "]}";
+}
+
+inline void write_json(std::ostream& os, const perf_result& res)
+{
+    os << "{\"clock\":" << json_string(res.clock) << ",\"overhead_ns\":" << res.overhead_ns
+       << ",\"overhead_noise_ns\":" << res.overhead_noise_ns;
+    if (res.bench_iterations != 0) {
+        os << ",\"bench_iterations\":" << res.bench_iterations << ",\"bench_ns\":" << res.bench_ns
+           << ",\"bench_ns_per_op\":" << res.bench_ns_per_op();
+    }
+    os << ",\"timers\":[";
+    for (size_t i = 0; i < res.timers.size(); ++i) {
+        os << ((i == 0) ? "" : ",");
+        write_json(os, res.timers[i]);
+    }
+    os << "],\"counters\":[";
+    for (size_t i = 0; i < res.counters.size(); ++i) {
+        const counter_result& c = res.counters[i];
+        os << ((i == 0) ? "" : ",") << "{\"name\":" << json_string(c.name) << ",\"kind\":\""
+           << counter_kind_name(c.kind) << "\",\"value\":" << c.value << ",\"derived\":" << c.derived;
+        if (c.timer_pos != counter::main_timer && c.timer_pos < res.timers.size()) {
+            os << ",\"timer\":" << json_string(res.timers[c.timer_pos].name);
+        }
+        os << "}";
+    }
+    os << "],\"memory\":";
+    write_json(os, res.memory);
+    if (! res.mt.empty()) {
+        os << ",\"mt\":[";
+        for (size_t i = 0; i < res.mt.size(); ++i) {
+            os << ((i == 0) ? "" : ",");
+            write_json(os, res.mt[i]);
+        }
+        os << "]";
+    }
+    os << "}";
+}
+
+/*
+ *  \brief  Machine readable results of the perf tests, one JSON object per
+ *          line and per test with all its measured repetitions.
+ */
+class results_file final
+{
+public:
+    static results_file& get_instance()
+    {
+        static results_file instance;
+        return instance;
+    }
+
+    bool write(const std::string& path, const std::string& test_name,
+               const std::vector<perf_result>& results)
+    {
+        std::ostringstream os;
+        os << std::setprecision(std::numeric_limits<double>::digits10 + 1);
+        os << "{\"test\":" << json_string(test_name) << ",\"seed\":" << options::get_instance().random_seed
+           << ",\"machine\":";
+        write_json(os, machine_info::get_instance());
+        os << ",\"repetitions\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            os << ((i == 0) ? "" : ",");
+            write_json(os, results[i]);
+        }
+        os << "]}" << '\n';
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (! m_os.is_open() || m_path != path) {
+            m_os.close();
+            m_os.clear();
+            m_os.open(path, std::ios::out | std::ios::app);
+            m_path = path;
+        }
+        m_os << os.str();
+        m_os.flush();
+        return m_os.good();
+    }
+
+private:
+    results_file() = default;
+
+private:
+    std::mutex m_mutex;
+    std::ofstream m_os;
+    std::string m_path;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_RESULTS_FILE_H */
@@ -0,0 +1,102 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_STATS_H
+#define _TESTING_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace testing {
+namespace details {
+
+struct summary
+{
+    size_t count = 0;
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double median = 0.0;
+    double stddev = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+
+    /* Coefficient of variation. */
+    double cv() const { return (mean != 0.0) ? stddev / mean : 0.0; }
+};
+
+/*
+ *  \brief  Percentile of sorted values with linear interpolation between
+ *          the closest ranks.
+ */
+inline double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+
+    const double rank = p / 100.0 * (double)(sorted.size() - 1);
+    const size_t lo = (size_t)rank;
+    const size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - (double)lo);
+}
+
+inline summary summarize(std::vector<double> values)
+{
+    summary s;
+    if (values.empty()) {
+        return s;
+    }
+
+    std::sort(values.begin(), values.end());
+    s.count = values.size();
+    s.min = values.front();
+    s.max = values.back();
+
+    double sum = 0.0;
+    for (double v : values) {
+        sum += v;
+    }
+    s.mean = sum / (double)s.count;
+
+    double sq_sum = 0.0;
+    for (double v : values) {
+        sq_sum += (v - s.mean) * (v - s.mean);
+    }
+    s.stddev = (s.count > 1) ? std::sqrt(sq_sum / (double)(s.count - 1)) : 0.0;
+
+    s.median = percentile(values, 50.0);
+    s.p90 = percentile(values, 90.0);
+    s.p99 = percentile(values, 99.0);
+    s.p999 = percentile(values, 99.9);
+    return s;
+}
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_STATS_H */
+
@@ -0,0 +1,113 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_TEST_FILTER_H
+#define _TESTING_TEST_FILTER_H
+
+#include <string>
+#include <vector>
+
+namespace testing {
+namespace details {
+
+/* Matches 'str' against a glob 'pattern' with '*' and '?' wildcards. */
+inline bool glob_match(const std::string& pattern, const std::string& str)
+{
+    size_t p = 0;
+    size_t s = 0;
+    size_t star_p = std::string::npos;
+    size_t star_s = 0;
+    while (s < str.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+            ++p;
+            ++s;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star_p = p++;
+            star_s = s;
+        } else if (star_p != std::string::npos) {
+            p = star_p + 1;
+            s = ++star_s;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+/*
+ *  \brief  Filter of the full test names 'suite.test': globs separated by
+ *          ':', the ones after a '-' exclude the tests, e.g.
+ *          'Suite.*:-*Slow*'. A filter of negative globs only keeps all the
+ *          other tests.
+ */
+class test_filter final
+{
+public:
+    explicit test_filter(const std::string& filter)
+    {
+        bool is_negative = false;
+        size_t begin = 0;
+        while (begin <= filter.size()) {
+            size_t end = filter.find(':', begin);
+            end = (end == std::string::npos) ? filter.size() : end;
+            std::string glob = filter.substr(begin, end - begin);
+            if (! glob.empty() && glob[0] == '-') {
+                is_negative = true;
+                glob.erase(0, 1);
+            }
+            if (! glob.empty()) {
+                (is_negative ? m_negative : m_positive).emplace_back(std::move(glob));
+            }
+            begin = end + 1;
+        }
+    }
+
+    bool match(const std::string& name) const
+    {
+        return (m_positive.empty() || match_any(m_positive, name)) && ! match_any(m_negative, name);
+    }
+
+private:
+    static bool match_any(const std::vector<std::string>& globs, const std::string& name)
+    {
+        for (const std::string& glob : globs) {
+            if (glob_match(glob, name)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::string> m_positive;
+    std::vector<std::string> m_negative;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_TEST_FILTER_H */
@@ -25,11 +25,25 @@
 #ifndef _TESTING_TEST_UTILS_H
 #define _TESTING_TEST_UTILS_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
+#include "testing/details/alloc_counters.h"
 #include "testing/details/common_test_utils.h"
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/heap_profiler.h"
+#include "testing/details/options.h"
+#include "testing/details/perf_report.h"
+#include "testing/details/results_file.h"
 #include "testing/details/timer.h"
 #include "testing/details/typed_test_utils.h"
 
@@ -46,88 +60,350 @@ public:
     virtual bool tear_down() = 0;
 };
 
-class itest_suite
+/*
+ *  \brief  Per-test attributes. Unset attributes fall back to the command
+ *          line options.
+ */
+class test_attrs final
 {
 public:
-    using ptr = std::shared_ptr<itest_suite>;
+    test_attrs& warmups(size_t count)
+    {
+        warmup_count = count;
+        return *this;
+    }
 
-    virtual ~itest_suite() {}
-    virtual void test_body() = 0;
-};
+    test_attrs& repetitions(size_t count)
+    {
+        repetition_count = count;
+        return *this;
+    }
 
-template<typename TType>
-class perf_decorator final : public itest_suite
-{
-public:
-    using ptr = std::shared_ptr<perf_decorator>;
+    test_attrs& max_cv(double pct)
+    {
+        max_cv_pct = pct;
+        return *this;
+    }
 
-    explicit perf_decorator(const std::shared_ptr<TType>& p_test)
-        : m_p_test(p_test)
-    {}
+    /* Time limit of the test, 0 disables it. */
+    test_attrs& timeout_ms(size_t ms)
+    {
+        time_limit_ms = ms;
+        return *this;
+    }
 
-    virtual void test_body() override { m_p_test->__run_perf(); }
+    /* Keeps the test out of the parallel run of --jobs. */
+    test_attrs& serial(bool is = true)
+    {
+        is_serial = is;
+        return *this;
+    }
 
-private:
-    std::shared_ptr<TType> m_p_test;
+public:
+    std::optional<size_t> warmup_count;
+    std::optional<size_t> repetition_count;
+    std::optional<double> max_cv_pct;
+    std::optional<bool> is_serial;
+    std::optional<size_t> time_limit_ms;
 };
 
-template<typename TType>
-class suite_decorator final : public itest_suite
+/*
+ *  \brief  Attributes shared by the tests of a suite.
+ */
+class suite_attrs final
 {
 public:
-    using ptr = std::shared_ptr<suite_decorator>;
+    /* Runs the tests of the suite serially, e.g. if they share fixture state. */
+    suite_attrs& serial()
+    {
+        is_serial = true;
+        return *this;
+    }
 
-    explicit suite_decorator(const std::shared_ptr<TType>& p_test)
-        : m_p_test(p_test)
-    {}
+public:
+    bool is_serial = false;
+};
 
-    virtual void test_body() override { m_p_test->__run(); }
+class itest_suite
+{
+public:
+    using ptr = std::shared_ptr<itest_suite>;
 
-private:
-    std::shared_ptr<TType> m_p_test;
+    virtual ~itest_suite() {}
+    virtual void test_body() = 0;
+    virtual void set_attrs(const test_attrs& /*attrs*/) {}
+    virtual void set_name(const std::string& /*name*/) {}
+    /* Default of the tests that must not run in parallel with others. */
+    virtual bool is_serial() const { return false; }
+    virtual bool is_perf() const { return false; }
 };
 
+/* Output of the running test, std::cout and std::cerr unless it is buffered. */
+inline std::ostream*& thread_output()
+{
+    static thread_local std::ostream* p_os = nullptr;
+    return p_os;
+}
+
+inline std::ostream& out() { return (thread_output() != nullptr) ? *thread_output() : std::cout; }
+inline std::ostream& err() { return (thread_output() != nullptr) ? *thread_output() : std::cerr; }
+
+/*
+ *  \brief  Failure state of the running test. The flags are atomic, so the
+ *          EXPECT and ASSERT macros may fail the test from any thread. Each
+ *          thread writes its messages into its own buffer. The messages of
+ *          the thread running the tests are printed at once, the ones of the
+ *          other threads are queued without locks and printed at test end.
+ */
 class test_failer final
 {
 public:
-    using ptr = std::shared_ptr<test_failer>;
+    test_failer() { m_runner_id.store(std::this_thread::get_id(), std::memory_order_relaxed); }
+
+    ~test_failer() { flush_messages(); }
 
     void init_case()
     {
-        m_is_ut_failed = false;
-        m_is_ut_fatal_failed = false;
+        m_runner_id.store(std::this_thread::get_id(), std::memory_order_relaxed);
+        m_is_ut_fatal_failed.store(false, std::memory_order_relaxed);
+        m_is_ut_failed.store(false, std::memory_order_release);
     }
 
-    bool is_case_failed() { return m_is_ut_failed; }
+    bool is_case_failed() const { return m_is_ut_failed.load(std::memory_order_acquire); }
 
-    void fail() { m_is_ut_failed = true; }
+    std::ostream& fail()
+    {
+        m_failures.fetch_add(1, std::memory_order_relaxed);
+        m_is_ut_failed.store(true, std::memory_order_release);
+        return thread_stream();
+    }
+
+    std::ostream& fatal()
+    {
+        m_is_ut_fatal_failed.store(true, std::memory_order_release);
+        return fail();
+    }
 
-    void fatal() { m_is_ut_fatal_failed = m_is_ut_failed = true; }
+    bool is_fatal() const { return m_is_ut_fatal_failed.load(std::memory_order_acquire); }
 
-    bool is_fatal() { return m_is_ut_fatal_failed; }
+    /* Failures reported so far, to tell whether one happened during a time window. */
+    uint64_t failures() const { return m_failures.load(std::memory_order_acquire); }
 
-    static test_failer& get_instance()
+    bool is_thread_stream(const std::ostream& os) const { return &os == &thread_stream(); }
+
+    /* Completes the message written into the stream of the calling thread. */
+    void commit_message()
     {
-        static bool is_once = true;
-        if (is_once) {
-            is_once = false;
-            m_p_instance.reset(new test_failer());
+        std::ostringstream& os = thread_stream();
+        std::string text = os.str();
+        os.str("");
+        if (std::this_thread::get_id() == m_runner_id.load(std::memory_order_relaxed)) {
+            err() << text;
+            return;
         }
-        return *m_p_instance.get();
+
+        message* p_msg = new message{std::move(text), std::this_thread::get_id(),
+                                     m_seq.fetch_add(1, std::memory_order_relaxed), nullptr};
+        p_msg->p_next = m_p_messages.load(std::memory_order_relaxed);
+        while (! m_p_messages.compare_exchange_weak(p_msg->p_next, p_msg, std::memory_order_release,
+                                                    std::memory_order_relaxed)) {}
+    }
+
+    /* Prints the queued messages of the other threads in the order they were reported. */
+    void flush_messages()
+    {
+        std::vector<std::unique_ptr<message>> msgs;
+        for (message* p_msg = m_p_messages.exchange(nullptr, std::memory_order_acquire);
+             p_msg != nullptr; p_msg = p_msg->p_next) {
+            msgs.emplace_back(p_msg);
+        }
+        std::sort(msgs.begin(), msgs.end(),
+            [](const std::unique_ptr<message>& l, const std::unique_ptr<message>& r) -> bool {
+                return l->seq < r->seq;
+            });
+        for (const std::unique_ptr<message>& p_msg : msgs) {
+            err() << "In thread " << p_msg->thread_id << ":" << std::endl << p_msg->text;
+        }
+    }
+
+    /* Failure state of the tests run by the calling thread, the process wide one if nullptr. */
+    static test_failer*& current()
+    {
+        static thread_local test_failer* p_current = nullptr;
+        return p_current;
+    }
+
+    static test_failer& get_instance()
+    {
+        return (current() != nullptr) ? *current() : process_instance();
+    }
+
+    /* Failure state of the threads which are not running tests, e.g. the ones a test started. */
+    static test_failer& process_instance()
+    {
+        static test_failer instance;
+        return instance;
     }
 
 private:
-    bool m_is_ut_failed = false;
-    bool m_is_ut_fatal_failed = false;
+    struct message
+    {
+        std::string text;
+        std::thread::id thread_id;
+        uint64_t seq;
+        message* p_next;
+    };
 
-    static std::unique_ptr<test_failer> m_p_instance;
-};
 
-std::unique_ptr<test_failer> test_failer::m_p_instance = nullptr;
+    static std::ostringstream& thread_stream()
+    {
+        static thread_local std::ostringstream os;
+        return os;
+    }
+
+private:
+    std::atomic<bool> m_is_ut_failed = false;
+    std::atomic<bool> m_is_ut_fatal_failed = false;
+    std::atomic<std::thread::id> m_runner_id = std::thread::id();
+    std::atomic<uint64_t> m_seq = 0;
+    std::atomic<uint64_t> m_failures = 0;
+    std::atomic<message*> m_p_messages = nullptr;
+};
 
 inline void init_case()      { test_failer::get_instance().init_case(); }
 inline bool is_case_failed() { return test_failer::get_instance().is_case_failed(); }
 inline bool is_fatal()       { return test_failer::get_instance().is_fatal(); }
+inline void flush_messages() { test_failer::get_instance().flush_messages(); }
+
+/*
+ *  \brief  Applies --perf_cpus, --perf_cpuset and --perf_fifo to the calling
+ *          thread of a perf test, 'idx' is the index of a thread of a
+ *          multithreaded test. A failure is reported once and ignored.
+ */
+inline void bind_perf_thread(cpu_binding& binding, size_t idx)
+{
+    static std::atomic<bool> is_pin_warned{false};
+    static std::atomic<bool> is_fifo_warned{false};
+
+    const options& opts = options::get_instance();
+    bool is_pinned = true;
+    if (! opts.perf_cpus.empty()) {
+        is_pinned = binding.pin({opts.perf_cpus[idx % opts.perf_cpus.size()]});
+    } else if (! opts.perf_cpuset.empty()) {
+        is_pinned = binding.pin(opts.perf_cpuset);
+    }
+    if (! is_pinned && ! is_pin_warned.exchange(true)) {
+        std::cout << "[ WARNING  ] Failed to pin the perf tests to the requested CPUs" << std::endl;
+    }
+    if (opts.perf_fifo && ! binding.set_fifo() && ! is_fifo_warned.exchange(true)) {
+        std::cout << "[ WARNING  ] SCHED_FIFO is not permitted, the perf tests keep their policy" << std::endl;
+    }
+}
+
+/* Applies --perf_mlock once, before the first perf test. */
+inline void lock_perf_memory()
+{
+    static const bool is_locked = options::get_instance().perf_mlock && lock_memory();
+    static std::atomic<bool> is_warned{false};
+    if (options::get_instance().perf_mlock && ! is_locked && ! is_warned.exchange(true)) {
+        std::cout << "[ WARNING  ] mlockall is not permitted, the memory of the perf tests may be paged out"
+                  << std::endl;
+    }
+}
+
+template<typename TType>
+class perf_decorator final : public itest_suite
+{
+public:
+    using ptr = std::shared_ptr<perf_decorator>;
+
+    perf_decorator() = default;
+
+    /*
+     *  A fresh fixture is created for every warmup and repetition, so none of
+     *  them sees the state of the previous one and filtered out tests never
+     *  create it.
+     */
+    virtual void test_body() override
+    {
+        const options& opts = options::get_instance();
+        static const test_attrs default_attrs;
+        const test_attrs& attrs = (m_p_attrs != nullptr) ? *m_p_attrs : default_attrs;
+        const size_t warmups = attrs.warmup_count.value_or(opts.perf_warmups);
+        const size_t repetitions = attrs.repetition_count.value_or(opts.perf_repetitions);
+
+        lock_perf_memory();
+        cpu_binding binding;
+        bind_perf_thread(binding, 0);
+
+        /* The warmups are silent, the messages of the test are discarded. */
+        std::ostream null_output(nullptr);
+        std::ostream* const p_output = thread_output();
+        thread_output() = &null_output;
+        for (size_t i = 0; i < warmups && ! is_case_failed(); ++i) {
+            const std::unique_ptr<TType> p_test(new TType());
+            p_test->__run_perf(false);
+        }
+        thread_output() = p_output;
+
+        const bool is_heap_profile = (opts.perf_heap_profile != 0) && is_alloc_hooks_installed();
+        if (opts.perf_heap_profile != 0 && ! is_alloc_hooks_installed()) {
+            std::cout << "[ WARNING  ] The heap profile requires testing/alloc_hooks.h" << std::endl;
+        }
+        if (is_heap_profile) {
+            heap_profiler::get_instance().start(opts.perf_heap_profile);
+        }
+
+        std::vector<perf_result> results;
+        for (size_t i = 0; i < repetitions && ! is_case_failed(); ++i) {
+            if (repetitions > 1) {
+                std::cout << "[   PERF   ]   repetition " << (i + 1) << " of " << repetitions << std::endl;
+            }
+            const std::unique_ptr<TType> p_test(new TType());
+            results.emplace_back(p_test->__run_perf(true));
+        }
+
+        if (results.size() > 1) {
+            print_repetitions(results, attrs.max_cv_pct.value_or(opts.perf_max_cv));
+        }
+        if (! opts.perf_results.empty() && ! results.empty()
+            && ! results_file::get_instance().write(opts.perf_results, m_name, results)) {
+            std::cout << "[ WARNING  ] Failed to write the results to " << opts.perf_results << std::endl;
+        }
+        if (is_heap_profile) {
+            heap_profiler::get_instance().stop();
+            heap_profiler::get_instance().print(std::cout, opts.perf_heap_top, "[   PERF   ]   ");
+        }
+    }
+
+    virtual void set_attrs(const test_attrs& attrs) override { m_p_attrs = &attrs; }
+
+    virtual void set_name(const std::string& name) override { m_name = name; }
+
+    /* Other tests running in parallel would disturb the measurements. */
+    virtual bool is_serial() const override { return true; }
+
+    virtual bool is_perf() const override { return true; }
+
+private:
+    const test_attrs* m_p_attrs = nullptr;
+    std::string m_name;
+};
+
+template<typename TType>
+class suite_decorator final : public itest_suite
+{
+public:
+    using ptr = std::shared_ptr<suite_decorator>;
+
+    suite_decorator() = default;
+
+    virtual void test_body() override
+    {
+        const std::unique_ptr<TType> p_test(new TType());
+        p_test->__run();
+    }
+};
 
 template<typename TEnv>
 class env_decorator final : public ienv
@@ -175,12 +451,11 @@ public:
             return true;
         }
 
-        std::shared_ptr<case_t> p_ptr = std::make_shared<case_t>();
-        typename decorator::ptr p_decorator = std::make_shared<decorator>(p_ptr);
+        typename decorator::ptr p_decorator = std::make_shared<decorator>();
 
         const std::string test_case_name = "[" + std::to_string(level) + "] " +
             case_name + "<" + canon_type_name<head_t>() + ">";
-        bool result = tester.insert(test_case_name, test_name, p_decorator);
+        bool result = tester.insert_test(test_case_name, test_name, p_decorator, case_name);
         if (! result) {
             return false;
         }
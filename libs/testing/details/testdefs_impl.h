@@ -66,6 +66,27 @@
 #define __TEST_TYPE_PARAMS(suite_name)              \
     __test_type_##suite_name##_param
 
+#define __TEST_ATTRS_RES(case_name, test_name)      \
+    __##case_name##_##test_name##_attrs
+
+#define __TEST_SUITE_ATTRS_RES(case_name)           \
+    __##case_name##_suite_attrs
+
+/*
+ *  \brief  Implementation for TEST_ATTRS and TEST_SUITE_ATTRS macros.
+ */
+
+#define __TEST_ATTRS_IMPL(case_name, test_name)                                \
+    [[maybe_unused]] static ::testing::details::test_attrs&                    \
+        __TEST_ATTRS_RES(case_name, test_name) =                               \
+            ::testing::details::tester::attrs(                                 \
+                __CVT_TO_STRING(case_name), __CVT_TO_STRING(test_name))
+
+#define __TEST_SUITE_ATTRS_IMPL(case_name)                                     \
+    [[maybe_unused]] static ::testing::details::suite_attrs&                   \
+        __TEST_SUITE_ATTRS_RES(case_name) =                                    \
+            ::testing::details::tester::attrs(__CVT_TO_STRING(case_name))
+
 /*
  *  \brief  Implementation for TEST macro.
  */
@@ -97,10 +118,7 @@
         __TEST_CLASS_NAME(suite_name, test_name)() {}                       \
         static suite_ptr make_suite_ptr()                                   \
         {                                                                   \
-            std::shared_ptr<__TEST_CLASS_NAME(suite_name, test_name)> p_ =  \
-                std::make_shared<__TEST_CLASS_NAME(suite_name,              \
-                                                   test_name)>();           \
-            return std::make_shared<decorator>(p_);                         \
+            return std::make_shared<decorator>();                           \
         }                                                                   \
     private:                                                                \
         virtual void test_body();                                           \
@@ -25,16 +25,33 @@
 #ifndef _TESTING_TESTER_H
 #define _TESTING_TESTER_H
 
+#include <sys/wait.h>
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 
+#include "testing/details/machine_info.h"
+#include "testing/details/options.h"
+#include "testing/details/process_pool.h"
+#include "testing/details/test_filter.h"
 #include "testing/details/test_utils.h"
 #include "testing/details/timer.h"
 #include "testing/details/typed_test_utils.h"
+#include "testing/details/watchdog.h"
+#include "testing/details/work_stealing.h"
 
 namespace testing {
 namespace details {
@@ -44,22 +61,32 @@ class test_suite final
 public:
     using ptr = std::shared_ptr<test_suite>;
     using case_ptr = itest_suite::ptr;
-    using test_descr_t = std::pair<std::string, case_ptr>;
-    using test_list_t = std::vector<test_descr_t>;
 
-    explicit test_suite(const std::string& suite_name)
+    struct test_descr
+    {
+        std::string name;
+        case_ptr p_case;
+        const test_attrs* p_attrs;
+        bool is_selected;
+        /* Registration order. */
+        size_t order;
+    };
+    using test_list_t = std::vector<test_descr>;
+
+    test_suite(const std::string& suite_name, const suite_attrs& attrs)
         : m_suite_name(suite_name)
+        , m_attrs(attrs)
     {}
 
-    bool insert_case(const std::string& test_name, const case_ptr& p_case)
+    bool insert_case(const std::string& test_name, const case_ptr& p_case, const test_attrs& attrs)
     {
-        m_tests.emplace_back(test_name, p_case);
+        m_tests.push_back(test_descr{test_name, p_case, &attrs, true, m_tests.size()});
         return true;
     }
 
     int run_all_cases() const
     {
-        const std::string prefix = std::to_string(m_tests.size()) + " tests from " + m_suite_name;
+        const std::string prefix = std::to_string(selected_count()) + " tests from " + m_suite_name;
 
         std::cout << "[----------] " << prefix << std::endl;
         timer suite_sw(true);
@@ -70,36 +97,92 @@ public:
         return failed_count;
     }
 
+    /*
+     *  \brief  Runs a test with the failure state of the calling thread and
+     *          prints to its output. Returns true if the test failed.
+     */
+    bool run_case(size_t idx) const
+    {
+        const test_descr& descr = m_tests[idx];
+
+        init_case();
+        out() << "[RUN       ] " << m_suite_name << "." << descr.name << std::endl;
+
+        const size_t time_limit_ms = descr.p_attrs->time_limit_ms.value_or(options::get_instance().timeout_ms);
+        const size_t watch_id = watchdog::get_instance().start(test_name(idx), time_limit_ms);
+        timer test_sw(true);
+        descr.p_case->test_body();
+        const double test_ms = test_sw.value_ms();
+        flush_messages();
+
+        const bool is_failed = is_case_failed();
+        watchdog::get_instance().finish(watch_id, is_failed);
+        const std::string res_str = is_failed ? "[   FAILED ] " : "[       OK ] ";
+        out() << res_str << m_suite_name << "." << descr.name << " (" << test_ms << " ms)" << std::endl;
+        return is_failed;
+    }
+
+    bool is_disabled(size_t idx) const { return m_tests[idx].name.rfind("DISABLED", 0) == 0; }
+
+    bool is_serial(size_t idx) const
+    {
+        const test_descr& descr = m_tests[idx];
+        return descr.p_attrs->is_serial.value_or(m_attrs.is_serial || descr.p_case->is_serial());
+    }
+
+    void print_disabled(size_t idx) const
+    {
+        std::cout << "[DISABLED  ] " << test_name(idx) << std::endl;
+    }
+
+    std::string test_name(size_t idx) const { return m_suite_name + "." + m_tests[idx].name; }
+
+    const std::string& case_name(size_t idx) const { return m_tests[idx].name; }
+
+    const std::string& name() const { return m_suite_name; }
+
     size_t tests_count() const { return m_tests.size(); }
 
-private:
-    static bool is_disabled(const std::string& test_name)
+    void shuffle(std::mt19937& rng) { std::shuffle(m_tests.begin(), m_tests.end(), rng); }
+
+    void restore_order()
+    {
+        std::sort(m_tests.begin(), m_tests.end(), [](const test_descr& l, const test_descr& r) -> bool {
+            return l.order < r.order;
+        });
+    }
+
+    /* Only the selected tests run, e.g. the ones of the shard. */
+    void select(size_t idx, bool is) { m_tests[idx].is_selected = is; }
+
+    bool is_selected(size_t idx) const { return m_tests[idx].is_selected; }
+
+    size_t selected_count() const
+    {
+        return std::count_if(m_tests.cbegin(), m_tests.cend(),
+                             [](const test_descr& descr) -> bool { return descr.is_selected; });
+    }
+
+    bool has_selected_perf() const
     {
-        return test_name.rfind("DISABLED", 0) == 0;
+        return std::any_of(m_tests.cbegin(), m_tests.cend(), [](const test_descr& descr) -> bool {
+            return descr.is_selected && descr.p_case->is_perf();
+        });
     }
 
+private:
     int run_tests() const
     {
         int failed_count = 0;
-        for (const test_descr_t& descr : m_tests) {
-            const std::string& test_name = descr.first;
-            const case_ptr& p_suite = descr.second;
-
-            if (is_disabled(test_name)) {
-                std::cout << "[DISABLED  ] " << m_suite_name << "." << test_name << std::endl;
+        for (size_t idx = 0; idx < m_tests.size(); ++idx) {
+            if (! is_selected(idx)) {
                 continue;
             }
-
-            init_case();
-            std::cout << "[RUN       ] " << m_suite_name << "." << test_name << std::endl;
-
-            timer test_sw(true);
-            p_suite->test_body();
-            const double test_ms = test_sw.value_ms();
-
-            failed_count += (is_case_failed() != 0) ? 1 : 0;
-            const std::string res_str = (is_case_failed() == 0) ? "[       OK ] " : "[   FAILED ] ";
-            std::cout << res_str << m_suite_name << "." << test_name << " (" << test_ms << " ms)" << std::endl;
+            if (is_disabled(idx)) {
+                print_disabled(idx);
+                continue;
+            }
+            failed_count += run_case(idx) ? 1 : 0;
         }
 
         return failed_count;
@@ -107,6 +190,7 @@ private:
 
 private:
     const std::string m_suite_name;
+    const suite_attrs& m_attrs;
     test_list_t m_tests;
 };
 
@@ -114,6 +198,7 @@ class tester final
 {
     using case_ptr = itest_suite::ptr;
     using suite_ptr = test_suite::ptr;
+    using test_ref = std::pair<const test_suite*, size_t>;
 
 public:
     virtual ~tester() {}
@@ -123,14 +208,51 @@ public:
     bool insert_test(const std::string& case_name, const std::string& test_name,
                      const case_ptr& p_suite)
     {
-        const size_t idx = gen_test_id(case_name);
-        return m_tests[idx]->insert_case(test_name, p_suite);
+        return insert_test(case_name, test_name, p_suite, case_name);
     }
 
-    int run_tests() const
+    /*
+     *  \brief  Inserts a test whose attributes are registered under
+     *          'attrs_case', e.g. the instantiations of a typed test.
+     */
+    bool insert_test(const std::string& case_name, const std::string& test_name,
+                     const case_ptr& p_suite, const std::string& attrs_case)
     {
-        const size_t tests_cnt = tests_count();
-        size_t failed_count = 0;
+        const size_t idx = gen_test_id(case_name, attrs_case);
+        const test_attrs& attrs = get_attrs(attrs_case, test_name);
+        p_suite->set_attrs(attrs);
+        p_suite->set_name(case_name + "." + test_name);
+        return m_tests[idx]->insert_case(test_name, p_suite, attrs);
+    }
+
+    test_attrs& get_attrs(const std::string& case_name, const std::string& test_name)
+    {
+        return m_attrs[case_name + "." + test_name];
+    }
+
+    suite_attrs& get_suite_attrs(const std::string& case_name) { return m_suite_attrs[case_name]; }
+
+    int run_tests()
+    {
+        const options& opts = options::get_instance();
+        if (opts.total_shards == 0 || opts.shard_index >= opts.total_shards) {
+            std::cerr << "[  ERROR   ] Invalid shard " << opts.shard_index << " of " << opts.total_shards << std::endl;
+            return 1;
+        }
+        select_filter(test_filter(opts.filter));
+        if (opts.total_shards > 1) {
+            select_shard(opts.shard_index, opts.total_shards);
+            std::cout << "[==========] Shard " << opts.shard_index << " of " << opts.total_shards << "." << std::endl;
+        }
+        if (opts.is_list) {
+            list_tests();
+            return 0;
+        }
+
+        if (std::any_of(m_tests.cbegin(), m_tests.cend(),
+                        [](const suite_ptr& p_test) -> bool { return p_test->has_selected_perf(); })) {
+            machine_info::get_instance().print(std::cout);
+        }
 
         std::cout << "[==========] Setup environments." << std::endl;
         for (const ienv::ptr& p_env : m_envs) {
@@ -139,29 +261,56 @@ public:
             }
         }
 
-        std::cout << "[==========] Running " << tests_cnt << " tests from "
-                  << m_tests.size() << " test suits." << std::endl;
-        timer total_sw(true);
-        for (const suite_ptr& p_test : m_tests) {
-            failed_count += p_test->run_all_cases();
+        const watchdog::clock::time_point run_start = watchdog::clock::now();
+        watchdog::get_instance().start_run(opts.global_timeout_ms, [&opts, run_start](size_t finished, size_t failed) {
+            std::cout << "[==========] " << finished << " tests ran before the timeout." << std::endl;
+            std::cout << "[  FAILED  ] " << failed << " tests." << std::endl;
+            if (! opts.shard_status_file.empty()) {
+                const std::chrono::duration<double, std::milli> run_ms = watchdog::clock::now() - run_start;
+                write_shard_status(opts.shard_status_file, finished, {failed}, run_ms.count());
+            }
+        });
+
+        options& mutable_opts = options::get_instance();
+        /* Only a shuffled run draws a seed, it is printed to replay the order. */
+        const uint32_t seed = opts.is_seed_set ? opts.random_seed
+                            : (opts.is_shuffle ? std::random_device()() : options::default_seed);
+        /* Failures are reported per pass, not summed, a test failing in every pass is one failing test. */
+        std::vector<size_t> pass_failed;
+        double total_ms = 0.0;
+        for (size_t i = 0; i < opts.repeat; ++i) {
+            if (opts.repeat > 1) {
+                std::cout << "[==========] Repetition " << (i + 1) << " of " << opts.repeat << "." << std::endl;
+            }
+            /* Every repetition has its own order, replayed by its printed seed. */
+            mutable_opts.random_seed = seed + (uint32_t)i;
+            if (opts.is_shuffle) {
+                std::cout << "[==========] Random seed: " << opts.random_seed << "." << std::endl;
+                shuffle(opts.random_seed);
+            }
+            double pass_ms = 0.0;
+            pass_failed.emplace_back(run_selected(pass_ms));
+            total_ms += pass_ms;
         }
-
-        const double total_ms = total_sw.value_ms();
-        std::cout << "[==========] " << tests_cnt << " tests from " << m_tests.size()
-                  << " test suits ran (" << total_ms << " ms)." << std::endl;
-        if (failed_count != 0) {
-            std::cout << "[  FAILED  ] " << failed_count << " tests." << std::endl;
+        if (! opts.shard_status_file.empty()) {
+            write_shard_status(opts.shard_status_file, tests_count(), pass_failed, total_ms);
+        }
+        const size_t failed_passes = std::count_if(pass_failed.cbegin(), pass_failed.cend(),
+                                                   [](size_t failed) -> bool { return failed != 0; });
+        if (opts.repeat > 1) {
+            std::cout << "[==========] " << failed_passes << " of " << opts.repeat << " repetitions failed." << std::endl;
         }
-        std::cout << "[  PASSED  ] " << tests_cnt << " tests." << std::endl;
 
         std::cout << "[==========] Teardown environments." << std::endl;
         for (const ienv::ptr& p_env : m_envs) {
             if (! p_env->tear_down()) {
+                watchdog::get_instance().stop_run();
                 return 1;
             }
         }
 
-        return (failed_count == 0) ? 0 : 1;
+        watchdog::get_instance().stop_run();
+        return (failed_passes == 0) ? 0 : 1;
     }
 
     static bool insert(const std::string& case_name, const std::string& test_name,
@@ -170,6 +319,16 @@ public:
         return get_instance().insert_test(case_name, test_name, p_suite);
     }
 
+    static test_attrs& attrs(const std::string& case_name, const std::string& test_name)
+    {
+        return get_instance().get_attrs(case_name, test_name);
+    }
+
+    static suite_attrs& attrs(const std::string& case_name)
+    {
+        return get_instance().get_suite_attrs(case_name);
+    }
+
     template<template<typename> class TCase, typename TTypes>
     static bool insert_typed_case(const std::string& case_name,
                                   const std::string& test_name)
@@ -190,55 +349,325 @@ public:
 
     static int run_all_tests() { return get_instance().run_tests(); }
 
+    static int run_all_tests(int argc, char** argv)
+    {
+        options& opts = options::get_instance();
+        if (! opts.parse(argc, argv)) {
+            return 1;
+        }
+        return opts.is_help ? 0 : run_all_tests();
+    }
+
 private:
     tester() = default;
 
+    /* Runs one pass of the selected tests, returns its failures and sets its time. */
+    size_t run_selected(double& total_ms) const
+    {
+        const options& opts = options::get_instance();
+        const size_t tests_cnt = tests_count();
+        const size_t suites_cnt = suites_count();
+        size_t failed_count = 0;
+
+        std::cout << "[==========] Running " << tests_cnt << " tests from "
+                  << suites_cnt << " test suits." << std::endl;
+        timer total_sw(true);
+        const size_t jobs = (opts.jobs != 0) ? opts.jobs : std::max(1u, std::thread::hardware_concurrency());
+        if (opts.is_fork) {
+            failed_count = run_forked(jobs);
+        } else if (jobs == 1) {
+            for (const suite_ptr& p_test : m_tests) {
+                if (p_test->selected_count() != 0) {
+                    failed_count += p_test->run_all_cases();
+                }
+            }
+        } else {
+            failed_count = run_parallel(jobs);
+        }
+
+        total_ms = total_sw.value_ms();
+        std::cout << "[==========] " << tests_cnt << " tests from " << suites_cnt
+                  << " test suits ran (" << total_ms << " ms)." << std::endl;
+        if (failed_count != 0) {
+            std::cout << "[  FAILED  ] " << failed_count << " tests." << std::endl;
+        }
+        std::cout << "[  PASSED  ] " << tests_cnt << " tests." << std::endl;
+        return failed_count;
+    }
+
+    /* Orders the suites and the tests of every suite randomly, from the registration order. */
+    void shuffle(uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        for (const suite_ptr& p_test : m_tests) {
+            p_test->restore_order();
+        }
+        std::sort(m_tests.begin(), m_tests.end(), [this](const suite_ptr& l, const suite_ptr& r) -> bool {
+            return m_case_names.at(l->name()) < m_case_names.at(r->name());
+        });
+        std::shuffle(m_tests.begin(), m_tests.end(), rng);
+        for (const suite_ptr& p_test : m_tests) {
+            p_test->shuffle(rng);
+        }
+    }
+
+    /* Keeps the tests matched by the filter, before any fixture is created. */
+    void select_filter(const test_filter& filter)
+    {
+        for (const suite_ptr& p_test : m_tests) {
+            for (size_t idx = 0; idx < p_test->tests_count(); ++idx) {
+                p_test->select(idx, filter.match(p_test->test_name(idx)));
+            }
+        }
+    }
+
+    void list_tests() const
+    {
+        for (const suite_ptr& p_test : m_tests) {
+            if (p_test->selected_count() == 0) {
+                continue;
+            }
+            std::cout << p_test->name() << "." << std::endl;
+            for (size_t idx = 0; idx < p_test->tests_count(); ++idx) {
+                if (p_test->is_selected(idx)) {
+                    std::cout << "  " << p_test->case_name(idx) << std::endl;
+                }
+            }
+        }
+    }
+
     size_t tests_count() const
     {
         return std::accumulate(m_tests.cbegin(), m_tests.cend(), 0,
-            [](size_t a, const suite_ptr& b) -> size_t { return a + b->tests_count(); });
+            [](size_t a, const suite_ptr& b) -> size_t { return a + b->selected_count(); });
+    }
+
+    size_t suites_count() const
+    {
+        return std::count_if(m_tests.cbegin(), m_tests.cend(),
+                             [](const suite_ptr& p_test) -> bool { return p_test->selected_count() != 0; });
+    }
+
+    /*
+     *  \brief  Keeps the selected tests of the shard. The tests are sorted by
+     *          name and dealt to the shards in turn, so every shard gets the
+     *          same number of tests whatever the size of the suites, and the
+     *          instantiations of a typed test are spread over the shards.
+     */
+    void select_shard(size_t index, size_t total)
+    {
+        std::vector<std::pair<std::string, std::pair<test_suite*, size_t>>> tests;
+        for (const suite_ptr& p_test : m_tests) {
+            for (size_t idx = 0; idx < p_test->tests_count(); ++idx) {
+                if (p_test->is_selected(idx)) {
+                    tests.emplace_back(p_test->test_name(idx), std::make_pair(p_test.get(), idx));
+                }
+            }
+        }
+        std::sort(tests.begin(), tests.end());
+        for (size_t i = 0; i < tests.size(); ++i) {
+            tests[i].second.first->select(tests[i].second.second, i % total == index);
+        }
     }
 
-    size_t gen_test_id(const std::string& case_name)
+    /*
+     *  \brief  Lets the orchestrator of the shards check that every one of
+     *          them ran. Written once per run, 'failed' is the worst pass and
+     *          'pass_failed' has the failures of every --repeat pass.
+     */
+    static void write_shard_status(const std::string& path, size_t tests,
+                                   const std::vector<size_t>& pass_failed, double ms)
+    {
+        const options& opts = options::get_instance();
+        std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+        ofs << "{\"shard_index\":" << opts.shard_index << ",\"total_shards\":" << opts.total_shards
+            << ",\"tests\":" << tests << ",\"failed\":"
+            << (pass_failed.empty() ? 0 : *std::max_element(pass_failed.cbegin(), pass_failed.cend()))
+            << ",\"pass_failed\":[";
+        for (size_t i = 0; i < pass_failed.size(); ++i) {
+            ofs << ((i != 0) ? "," : "") << pass_failed[i];
+        }
+        ofs << "],\"ms\":" << ms << "}" << std::endl;
+        if (! ofs) {
+            std::cerr << "[ WARNING  ] Failed to write the shard status to " << path << std::endl;
+        }
+    }
+
+    size_t gen_test_id(const std::string& case_name, const std::string& attrs_case)
     {
         std::map<std::string, size_t>::iterator it = m_case_names.find(case_name);
         if (it == m_case_names.cend()) {
             it = m_case_names.emplace(case_name, m_tests.size()).first;
-            m_tests.emplace_back(std::make_shared<test_suite>(case_name));
+            m_tests.emplace_back(std::make_shared<test_suite>(case_name, get_suite_attrs(attrs_case)));
         }
         return it->second;
     }
 
+    /* Enabled tests which may run in parallel with others and the serial ones. */
+    void split_tests(std::vector<test_ref>& parallel_tests, std::vector<test_ref>& serial_tests) const
+    {
+        for (const suite_ptr& p_test : m_tests) {
+            for (size_t idx = 0; idx < p_test->tests_count(); ++idx) {
+                if (! p_test->is_selected(idx)) {
+                    continue;
+                }
+                if (p_test->is_disabled(idx)) {
+                    p_test->print_disabled(idx);
+                } else {
+                    (p_test->is_serial(idx) ? serial_tests : parallel_tests).emplace_back(p_test.get(), idx);
+                }
+            }
+        }
+    }
+
+    /*
+     *  \brief  Runs the tests on 'jobs' threads with work stealing. The output
+     *          of every test is buffered and printed at once when it completes.
+     *          The serial tests run on the calling thread afterwards.
+     *
+     *  The threads a test starts do not inherit the failure state of its job
+     *  and fail into the process wide one. A test which ran while such a
+     *  failure was reported is run again serially, where its threads share
+     *  its failure state, and that run decides its result. Mark the tests
+     *  starting threads serial() to run them once.
+     */
+    size_t run_parallel(size_t jobs) const
+    {
+        std::vector<test_ref> parallel_tests;
+        std::vector<test_ref> serial_tests;
+        split_tests(parallel_tests, serial_tests);
+
+        std::cout << "[----------] " << parallel_tests.size() << " tests on " << jobs << " threads" << std::endl;
+        init_case();
+        const test_failer& process_failer = test_failer::process_instance();
+        std::vector<char> is_failed(parallel_tests.size(), 0);
+        std::vector<char> is_suspect(parallel_tests.size(), 0);
+        std::mutex output_mutex;
+        work_stealing_pool(jobs).run(parallel_tests.size(), [&](size_t i) {
+            std::ostringstream os;
+            const uint64_t process_failures = process_failer.failures();
+            {
+                test_failer failer;
+                test_failer::current() = &failer;
+                thread_output() = &os;
+                is_failed[i] = parallel_tests[i].first->run_case(parallel_tests[i].second) ? 1 : 0;
+                thread_output() = nullptr;
+                test_failer::current() = nullptr;
+            }
+            is_suspect[i] = (process_failer.failures() != process_failures) ? 1 : 0;
+
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cout << os.str() << std::flush;
+        });
+        flush_messages();
+        if (is_case_failed()) {
+            bool is_attributed = false;
+            for (size_t i = 0; i < parallel_tests.size(); ++i) {
+                if (! is_suspect[i]) {
+                    continue;
+                }
+                std::cout << "[ RERUN    ] " << parallel_tests[i].first->test_name(parallel_tests[i].second)
+                          << " ran while a thread outside of the tests failed, running it serially"
+                          << std::endl;
+                is_failed[i] = parallel_tests[i].first->run_case(parallel_tests[i].second) ? 1 : 0;
+                is_attributed = is_attributed || is_failed[i];
+            }
+            if (! is_attributed) {
+                std::cout << "[   FAILED ] failures reported outside of the parallel tests" << std::endl;
+                is_failed.emplace_back(1);
+            }
+        }
+        size_t failed_count = std::count(is_failed.cbegin(), is_failed.cend(), 1);
+
+        std::cout << "[----------] " << serial_tests.size() << " serial tests" << std::endl;
+        for (const test_ref& ref : serial_tests) {
+            failed_count += ref.first->run_case(ref.second) ? 1 : 0;
+        }
+        std::cout << std::endl;
+        return failed_count;
+    }
+
+    /*
+     *  \brief  Runs every test in one of 'workers' forked processes, so a
+     *          test which crashes fails alone. The serial tests run one at a
+     *          time afterwards.
+     */
+    size_t run_forked(size_t workers) const
+    {
+        std::vector<test_ref> tests;
+        std::vector<test_ref> serial_tests;
+        split_tests(tests, serial_tests);
+        const size_t parallel_count = tests.size();
+        tests.insert(tests.end(), serial_tests.begin(), serial_tests.end());
+
+        size_t failed_count = 0;
+        process_pool pool(workers, [&tests](size_t i) { return tests[i].first->run_case(tests[i].second); });
+        const process_pool::done_fn done = [&](size_t i, const process_pool::result& res) {
+            std::cout << res.output;
+            watchdog::get_instance().count(res.is_failed);
+            if (res.is_crashed) {
+                std::cout << "[   FAILED ] " << tests[i].first->test_name(tests[i].second) << " ("
+                          << crash_reason(res.status) << ")" << std::endl;
+            }
+            failed_count += res.is_failed ? 1 : 0;
+        };
+
+        std::vector<size_t> tasks(parallel_count);
+        std::iota(tasks.begin(), tasks.end(), 0);
+        std::cout << "[----------] " << tasks.size() << " tests in " << workers << " processes" << std::endl;
+        bool is_ok = pool.run(tasks, workers, done);
+
+        tasks.resize(serial_tests.size());
+        std::iota(tasks.begin(), tasks.end(), parallel_count);
+        std::cout << "[----------] " << tasks.size() << " serial tests" << std::endl;
+        is_ok = is_ok && pool.run(tasks, 1, done);
+        std::cout << std::endl;
+
+        return is_ok ? failed_count : failed_count + 1;
+    }
+
+    static std::string crash_reason(int status)
+    {
+        if (WIFSIGNALED(status)) {
+            return "crashed with signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+        }
+        return "exited with status " + std::to_string(WEXITSTATUS(status));
+    }
+
 private:
     std::vector<ienv::ptr> m_envs;
 
     std::map<std::string, size_t> m_case_names;
     std::vector<suite_ptr> m_tests;
+    /* Node based, so the tests keep pointers to their attributes. */
+    std::map<std::string, test_attrs> m_attrs;
+    std::map<std::string, suite_attrs> m_suite_attrs;
 
     static std::unique_ptr<tester> m_p_instance;
 };
 
 std::unique_ptr<tester> tester::m_p_instance = nullptr;
 
-std::ostream& fail()
-{
-    test_failer::get_instance().fail();
-    return std::cerr;
-}
+std::ostream& fail() { return test_failer::get_instance().fail(); }
 
-std::ostream& fatal()
-{
-    test_failer::get_instance().fatal();
-    return std::cerr;
-}
+std::ostream& fatal() { return test_failer::get_instance().fatal(); }
 
-std::ostream& msg() { return std::cout; }
+std::ostream& msg() { return out(); }
 
 class report_helper final
 {
 public:
     report_helper() {}
-    void operator=(std::ostream& msg) const { msg << std::endl; }
+    void operator=(std::ostream& msg) const
+    {
+        msg << std::endl;
+        if (test_failer::get_instance().is_thread_stream(msg)) {
+            test_failer::get_instance().commit_message();
+            if (options::get_instance().is_break_on_failure) {
+                std::raise(SIGTRAP);
+            }
+        }
+    }
 };
 
 } // namespace details
@@ -0,0 +1,60 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_THREAD_TABLES_H
+#define _TESTING_THREAD_TABLES_H
+
+#include <cstddef>
+
+#include "testing/details/counter_table.h"
+#include "testing/details/timer_table.h"
+
+namespace testing {
+namespace details {
+
+/* Thread count of a multithreaded perf test that sweeps 1, 2, 4, ... threads. */
+constexpr size_t threads_sweep = 0;
+
+/*
+ *  \brief  Timers and counters owned by one thread of a multithreaded perf
+ *          test. The perf macros of the test body resolve to the tables of
+ *          the calling thread, so the threads never share them.
+ */
+struct thread_tables
+{
+    timer_table timers;
+    counter_table counters;
+
+    /* Tables of the calling thread, nullptr outside of the test threads. */
+    static thread_tables*& current()
+    {
+        static thread_local thread_tables* p_current = nullptr;
+        return p_current;
+    }
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_THREAD_TABLES_H */
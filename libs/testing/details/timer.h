@@ -25,17 +25,25 @@
 #ifndef _TESTING_TIMER_H
 #define _TESTING_TIMER_H
 
-#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "testing/details/clock.h"
+#include "testing/details/histogram.h"
 
 namespace testing {
 namespace details {
 
-class timer final
+template<typename TClock>
+class basic_timer final
 {
-    using time_point = std::chrono::time_point<std::chrono::high_resolution_clock>;
-
 public:
-    timer(bool run = false)
+    using clock = TClock;
+
+    basic_timer(bool run = false)
     {
         if (run) {
             start();
@@ -44,8 +52,17 @@ public:
 
     void pause()
     {
-        m_time_ms = value_ms();
-        is_start = false;
+        if (is_start) {
+            const uint64_t ticks = clock::stop() - m_start;
+            m_ticks += ticks;
+            ++m_count;
+            is_start = false;
+            if (m_p_histogram) {
+                m_p_histogram->record(ticks);
+            } else if (m_samples.size() < m_samples_limit) {
+                m_samples.push_back(ticks);
+            }
+        }
     }
 
     void restart()
@@ -57,31 +74,132 @@ public:
     void start()
     {
         is_start = true;
-        m_start = std::chrono::high_resolution_clock::now();
+        m_start = clock::start();
     }
 
     void stop()
     {
         is_start = false;
-        m_time_ms = 0.0;
+        m_ticks = 0;
+        m_count = 0;
+        m_samples.clear();
+        if (m_p_histogram) {
+            m_p_histogram->clear();
+        }
     }
 
-    double value_ms()
+    /*
+     *  Records the first 'limit' intervals. The whole buffer is reserved here,
+     *  so pause() never allocates, keep the limit small for nested timers.
+     */
+    void record_samples(size_t limit)
     {
-        if (is_start) {
-            time_point cur = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> ms_double = cur - m_start;
-            m_time_ms += ms_double.count();
+        m_samples.reserve(limit);
+        m_samples_limit = limit;
+    }
+
+    /* Records the intervals into a constant memory histogram of ticks instead. */
+    void record_histogram()
+    {
+        m_p_histogram.reset(new histogram());
+        m_samples = std::vector<uint64_t>();
+        m_samples_limit = 0;
+    }
+
+    const histogram* get_histogram() const { return m_p_histogram.get(); }
+
+    std::vector<double> samples_ns() const
+    {
+        std::vector<double> samples;
+        samples.reserve(m_samples.size());
+        for (uint64_t ticks : m_samples) {
+            samples.emplace_back((double)clock::to_ns(ticks));
         }
-        return m_time_ms;
+        return samples;
+    }
+
+    uint64_t count() const { return m_count; }
+
+    uint64_t value_ns() const
+    {
+        return clock::to_ns(is_start ? m_ticks + clock::stop() - m_start : m_ticks);
     }
 
+    double value_ms() const { return (double)value_ns() / 1000000.0; }
+
 private:
     bool is_start = false;
-    time_point m_start;
-    double m_time_ms = 0.0;
+    uint64_t m_start = 0;
+    uint64_t m_ticks = 0;
+    uint64_t m_count = 0;
+    size_t m_samples_limit = 0;
+    std::vector<uint64_t> m_samples;
+    std::unique_ptr<histogram> m_p_histogram;
+};
+
+using timer = basic_timer<steady_clock>;
+using perf_timer = basic_timer<perf_clock>;
+
+enum class overhead_type
+{
+    none,
+    min,
+    median
+};
+
+/*
+ *  \brief  Intervals reported by an empty start/pause pair of the perf timer
+ *          with the current clock. They are measured once per clock.
+ */
+struct timer_calibration
+{
+    uint64_t min_ns = 0;
+    uint64_t median_ns = 0;
+    /* Uncertainty of the overhead of an interval, median minus min. */
+    uint64_t noise_ns = 0;
 };
 
+inline const timer_calibration& perf_timer_calibration()
+{
+    const size_t samples_count = 10000;
+    const size_t warmup_count = 100;
+    const size_t clocks_count = (size_t)clock_type::tsc + 1;
+
+    /* Once per clock, the threads of the tests may ask for it concurrently. */
+    static std::once_flag is_calibrated[clocks_count];
+    static timer_calibration calibrations[clocks_count];
+
+    const size_t idx = (size_t)perf_clock::current();
+    std::call_once(is_calibrated[idx], [idx]() {
+        std::vector<uint64_t> samples;
+        samples.reserve(samples_count);
+        perf_timer sw;
+        for (size_t i = 0; i < warmup_count + samples_count; ++i) {
+            sw.start();
+            sw.pause();
+            if (i >= warmup_count) {
+                samples.emplace_back(sw.value_ns());
+            }
+            sw.stop();
+        }
+        std::sort(samples.begin(), samples.end());
+        calibrations[idx].min_ns = samples.front();
+        calibrations[idx].median_ns = samples[samples.size() / 2];
+        calibrations[idx].noise_ns = calibrations[idx].median_ns - calibrations[idx].min_ns;
+    });
+    return calibrations[idx];
+}
+
+/* Per interval overhead subtracted from the timers, the minimum is the cost the clock reads always have. */
+inline uint64_t perf_timer_overhead_ns(overhead_type type)
+{
+    switch (type) {
+    case overhead_type::min:    return perf_timer_calibration().min_ns;
+    case overhead_type::median: return perf_timer_calibration().median_ns;
+    default:                    return 0;
+    }
+}
+
 } // namespace details
 } // namespace testing
 
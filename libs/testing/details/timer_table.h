@@ -0,0 +1,346 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_TIMER_TABLE_H
+#define _TESTING_TIMER_TABLE_H
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "testing/details/alloc_counters.h"
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/cpu_time.h"
+#include "testing/details/perf_events.h"
+#include "testing/details/resource_usage.h"
+#include "testing/details/timer.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Contiguous storage of the named perf timers of a test.
+ *
+ *  Timers are resolved by name only once, on registration. The returned
+ *  handle addresses the timer by index, so start/pause on the hot path do
+ *  neither allocate nor look up.
+ */
+class timer_table final
+{
+public:
+    class handle final
+    {
+    public:
+        handle(timer_table& table, size_t idx)
+            : m_p_table(&table)
+            , m_idx(idx)
+        {}
+
+        void start()
+        {
+            if (m_p_table->is_counting()) {
+                m_p_table->start_counts(m_idx);
+            }
+            get().start();
+        }
+
+        void restart()
+        {
+            if (m_p_table->is_counting()) {
+                m_p_table->m_counts[m_idx] = interval_counts();
+                m_p_table->start_counts(m_idx);
+            }
+            get().restart();
+        }
+
+        void pause()
+        {
+            get().pause();
+            if (m_p_table->is_counting()) {
+                m_p_table->pause_counts(m_idx);
+            }
+        }
+
+        double value_ms() const { return get().value_ms(); }
+
+        const alloc_counts& allocs() const { return m_p_table->allocs(m_idx); }
+
+        size_t index() const { return m_idx; }
+
+    private:
+        perf_timer& get() const { return m_p_table->m_timers[m_idx]; }
+
+    private:
+        timer_table* m_p_table;
+        size_t m_idx;
+    };
+
+    /* Index of a timer cached by a call site, valid for one generation of a table. */
+    struct handle_cache
+    {
+        uint64_t generation = 0;
+        size_t idx = 0;
+    };
+
+    timer_table()
+        : m_generation(next_generation())
+    {}
+
+    /* The handle of the registered timer 'name', looked up only if 'cache' is stale. */
+    handle cached(handle_cache& cache, const char* name)
+    {
+        if (cache.generation != m_generation) {
+            cache.idx = m_ids.at(name);
+            cache.generation = m_generation;
+        }
+        return handle(*this, cache.idx);
+    }
+
+    handle register_timer(size_t lvl, const std::string& name, bool is_histogram = false)
+    {
+        std::unordered_map<std::string, size_t>::const_iterator it = m_ids.find(name);
+        if (it != m_ids.cend()) {
+            return handle(*this, it->second);
+        }
+
+        const size_t idx = m_timers.size();
+        m_timers.emplace_back();
+        if (is_histogram || m_is_histogram) {
+            m_timers.back().record_histogram();
+        } else {
+            m_timers.back().record_samples(m_samples_limit);
+        }
+        m_counts.emplace_back();
+        m_names.emplace_back(name);
+        m_ids.emplace(name, idx);
+        if (m_hierarchy.size() <= lvl) {
+            m_hierarchy.resize(lvl + 1);
+        }
+        m_hierarchy[lvl].emplace_back(idx);
+        return handle(*this, idx);
+    }
+
+    void set_samples_limit(size_t limit) { m_samples_limit = limit; }
+
+    void set_histogram(bool is_histogram) { m_is_histogram = is_histogram; }
+
+    /* Samples, histogram and CPU time settings of 'other', for the tables of worker threads. */
+    void copy_settings(const timer_table& other)
+    {
+        m_samples_limit = other.m_samples_limit;
+        m_is_histogram = other.m_is_histogram;
+        m_is_cpu_time = other.m_is_cpu_time;
+        m_is_cpu_tracking = other.m_is_cpu_tracking;
+    }
+
+    /* Accumulates the counters of 'p_events' over the timer intervals. */
+    void set_events(const perf_events* p_events) { m_p_events = p_events; }
+
+    const perf_events* get_events() const { return m_p_events; }
+
+    const perf_events::values& events(size_t idx) const { return m_counts[idx].events; }
+
+    /* Accumulates the CPU time of the calling thread over the timer intervals. */
+    void set_cpu_time(bool is_cpu_time) { m_is_cpu_time = is_cpu_time; }
+
+    bool is_cpu_time() const { return m_is_cpu_time; }
+
+    uint64_t cpu_ns(size_t idx) const { return m_counts[idx].cpu_ns; }
+
+    /* Records the CPUs of the timer intervals and the migrations between them. */
+    void set_cpu_tracking(bool is_cpu_tracking) { m_is_cpu_tracking = is_cpu_tracking; }
+
+    bool is_cpu_tracking() const { return m_is_cpu_tracking; }
+
+    const cpu_placement& placement(size_t idx) const { return m_counts[idx].placement; }
+
+    /* Records the steady clock time of the first start and of the last pause of every timer. */
+    void set_span(bool is_span) { m_is_span = is_span; }
+
+    uint64_t span_begin_ns(size_t idx) const { return m_counts[idx].span_begin_ns; }
+
+    uint64_t span_end_ns(size_t idx) const { return m_counts[idx].span_end_ns; }
+
+    /* Accumulates faults, context switches and I/O of 'p_resources' over the intervals. */
+    void set_resources(const resource_reader* p_resources) { m_p_resources = p_resources; }
+
+    const resource_reader* get_resources() const { return m_p_resources; }
+
+    const resource_usage& resources(size_t idx) const { return m_counts[idx].resources; }
+
+    /* Heap activity of the timer intervals, if testing/alloc_hooks.h is used. */
+    const alloc_counts& allocs(size_t idx) const { return m_counts[idx].allocs; }
+
+    /*
+     *  \brief  CPU time an empty start/pause pair of a timer counting CPU time
+     *          reports: the clock reads it wraps besides the measured code.
+     */
+    static uint64_t cpu_time_overhead_ns()
+    {
+        static const uint64_t overhead_ns = [] {
+            const size_t samples_count = 1000;
+            timer_table table;
+            table.set_cpu_time(true);
+            handle sw = table.register_timer(0, "overhead");
+            for (size_t i = 0; i < samples_count; ++i) {
+                sw.start();
+                sw.pause();
+            }
+            return table.cpu_ns(sw.index()) / samples_count;
+        }();
+        return overhead_ns;
+    }
+
+    /* Stops the timers starting from 'first', keeping them registered. */
+    void reset(size_t first = 0)
+    {
+        for (size_t i = first; i < m_timers.size(); ++i) {
+            m_timers[i].stop();
+            m_counts[i] = interval_counts();
+        }
+    }
+
+    size_t size() const { return m_timers.size(); }
+
+    void clear()
+    {
+        m_timers.clear();
+        m_counts.clear();
+        m_names.clear();
+        m_ids.clear();
+        m_hierarchy.clear();
+        m_generation = next_generation();
+    }
+
+    perf_timer& at(size_t idx) { return m_timers[idx]; }
+    const perf_timer& at(size_t idx) const { return m_timers[idx]; }
+    perf_timer& at(const std::string& name) { return m_timers[m_ids.at(name)]; }
+
+    const std::string& name(size_t idx) const { return m_names[idx]; }
+
+    const std::vector<std::vector<size_t>>& hierarchy() const { return m_hierarchy; }
+
+private:
+    struct interval_counts
+    {
+        perf_events::sample events_start;
+        perf_events::values events;
+        uint64_t cpu_start_ns = 0;
+        uint64_t cpu_ns = 0;
+        alloc_counts allocs_start;
+        alloc_counts allocs;
+        resource_usage resources_start;
+        resource_usage resources;
+        cpu_placement placement;
+        uint64_t span_begin_ns = 0;
+        uint64_t span_end_ns = 0;
+        bool is_start = false;
+    };
+
+    static uint64_t next_generation()
+    {
+        static std::atomic<uint64_t> generation(0);
+        return ++generation;
+    }
+
+    bool is_counting() const
+    {
+        return m_p_events != nullptr || m_p_resources != nullptr || m_is_cpu_time || m_is_cpu_tracking
+            || m_is_span || is_alloc_hooks_installed();
+    }
+
+    void start_counts(size_t idx)
+    {
+        interval_counts& counts = m_counts[idx];
+        if (m_is_cpu_tracking) {
+            counts.placement.record(current_cpu());
+        }
+        if (m_p_events != nullptr) {
+            m_p_events->read(counts.events_start);
+        }
+        if (m_is_cpu_time) {
+            counts.cpu_start_ns = thread_cpu_time_ns();
+        }
+        if (m_p_resources != nullptr) {
+            m_p_resources->read(counts.resources_start);
+        }
+        counts.allocs_start = thread_alloc_counts();
+        if (m_is_span && counts.span_begin_ns == 0) {
+            counts.span_begin_ns = steady_clock::now();
+        }
+        counts.is_start = true;
+    }
+
+    void pause_counts(size_t idx)
+    {
+        interval_counts& counts = m_counts[idx];
+        if (! counts.is_start) {
+            return;
+        }
+        if (m_is_span) {
+            counts.span_end_ns = steady_clock::now();
+        }
+
+        counts.allocs += thread_alloc_counts() - counts.allocs_start;
+        if (m_p_resources != nullptr) {
+            resource_usage cur;
+            m_p_resources->read(cur);
+            counts.resources += cur - counts.resources_start;
+        }
+        if (m_is_cpu_time) {
+            counts.cpu_ns += thread_cpu_time_ns() - counts.cpu_start_ns;
+        }
+        if (m_p_events != nullptr) {
+            perf_events::sample cur;
+            m_p_events->read(cur);
+            m_p_events->accumulate(counts.events_start, cur, counts.events);
+        }
+        if (m_is_cpu_tracking) {
+            counts.placement.record(current_cpu());
+        }
+        counts.is_start = false;
+    }
+
+private:
+    std::vector<perf_timer> m_timers;
+    std::vector<interval_counts> m_counts;
+    std::vector<std::string> m_names;
+    std::unordered_map<std::string, size_t> m_ids;
+    std::vector<std::vector<size_t>> m_hierarchy;
+    uint64_t m_generation;
+    size_t m_samples_limit = 0;
+    bool m_is_histogram = false;
+    bool m_is_cpu_time = false;
+    bool m_is_cpu_tracking = false;
+    bool m_is_span = false;
+    const perf_events* m_p_events = nullptr;
+    const resource_reader* m_p_resources = nullptr;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_TIMER_TABLE_H */
+
@@ -0,0 +1,368 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_WATCHDOG_H
+#define _TESTING_WATCHDOG_H
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing/details/backtrace.h"
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Enforces the time limits of the running tests and of the whole
+ *          run from a thread of its own. A hung test cannot be stopped, so on
+ *          expiry the watchdog prints the test, its elapsed time and the
+ *          backtraces of all threads, reports the results gathered so far and
+ *          exits the process.
+ */
+class watchdog final
+{
+public:
+    using clock = std::chrono::steady_clock;
+    /* Reports the results so far, the tests finished and failed with the expired one. */
+    using abort_fn = std::function<void(size_t, size_t)>;
+
+    static watchdog& get_instance()
+    {
+        static watchdog instance;
+        return instance;
+    }
+
+    ~watchdog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+            m_is_stop = true;
+        }
+        m_p_sync->cv.notify_all();
+        if (m_p_thread && m_p_thread->joinable()) {
+            m_p_thread->join();
+        }
+    }
+
+    /* Limits the whole run to 'timeout_ms', 0 disables the limit. */
+    void start_run(uint64_t timeout_ms, abort_fn on_abort)
+    {
+        std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+        m_on_abort = std::move(on_abort);
+        m_is_run_limited = (timeout_ms != 0);
+        m_run_start = clock::now();
+        m_run_deadline = m_run_start + std::chrono::milliseconds(timeout_ms);
+        m_run_timeout_ms = timeout_ms;
+        arm();
+    }
+
+    /* Disarms the limit of start_run(), the callback is dropped with the state it refers to. */
+    void stop_run()
+    {
+        std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+        m_is_run_limited = false;
+        m_on_abort = nullptr;
+        m_p_sync->cv.notify_all();
+    }
+
+    /* Limits the test to 'timeout_ms', 0 disables the limit. Returns the id for finish(). */
+    size_t start(const std::string& name, uint64_t timeout_ms)
+    {
+        std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+        const size_t id = ++m_last_id;
+        if (timeout_ms != 0) {
+            const clock::time_point now = clock::now();
+            m_tests.push_back(entry{id, name, now, now + std::chrono::milliseconds(timeout_ms), timeout_ms});
+            arm();
+        }
+        return id;
+    }
+
+    void finish(size_t id, bool is_failed)
+    {
+        std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+        m_tests.remove_if([id](const entry& e) -> bool { return e.id == id; });
+        ++m_finished;
+        m_failed += is_failed ? 1 : 0;
+    }
+
+    /* Counts a test which ran elsewhere, e.g. in a forked worker. */
+    void count(bool is_failed)
+    {
+        std::lock_guard<std::mutex> lock(m_p_sync->mutex);
+        ++m_finished;
+        m_failed += is_failed ? 1 : 0;
+    }
+
+    /*
+     *  \brief  Resets the state in a forked worker, where the watchdog thread
+     *          does not exist. The mutex may be held and the condition variable
+     *          waited on by that thread, so they are left to leak and the
+     *          worker gets new ones. The parent enforces the limit of the run.
+     */
+    void after_fork()
+    {
+        m_p_sync.release();
+        m_p_sync.reset(new sync());
+        m_p_thread.release();
+        m_tests.clear();
+        m_is_run_limited = false;
+        m_on_abort = nullptr;
+    }
+
+private:
+    struct entry
+    {
+        size_t id;
+        std::string name;
+        clock::time_point start;
+        clock::time_point deadline;
+        uint64_t timeout_ms;
+    };
+
+    struct sync
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    watchdog()
+        : m_p_sync(new sync())
+    {}
+
+    void arm()
+    {
+        if (! m_p_thread) {
+            prepare_dump();
+            m_p_thread.reset(new std::thread([this]() { watch(); }));
+        } else {
+            m_p_sync->cv.notify_all();
+        }
+    }
+
+    void watch()
+    {
+        std::unique_lock<std::mutex> lock(m_p_sync->mutex);
+        while (! m_is_stop) {
+            clock::time_point deadline = clock::time_point::max();
+            if (m_is_run_limited) {
+                deadline = m_run_deadline;
+            }
+            for (const entry& e : m_tests) {
+                deadline = std::min(deadline, e.deadline);
+            }
+
+            if (deadline == clock::time_point::max()) {
+                m_p_sync->cv.wait(lock);
+            } else if (m_p_sync->cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+                expire(clock::now());
+            }
+        }
+    }
+
+    void expire(clock::time_point now)
+    {
+        std::vector<const entry*> expired;
+        for (const entry& e : m_tests) {
+            if (e.deadline <= now) {
+                expired.emplace_back(&e);
+            }
+        }
+        const bool is_run_expired = m_is_run_limited && m_run_deadline <= now;
+        if (expired.empty() && ! is_run_expired) {
+            return;
+        }
+
+        if (is_run_expired) {
+            std::cout << "[ TIMEOUT  ] The run exceeded the time limit of " << m_run_timeout_ms << " ms ("
+                      << elapsed_ms(m_run_start, now) << " ms)" << std::endl;
+        }
+        for (const entry* p_entry : expired) {
+            std::cout << "[ TIMEOUT  ] " << p_entry->name << " exceeded the time limit of "
+                      << p_entry->timeout_ms << " ms (" << elapsed_ms(p_entry->start, now) << " ms)" << std::endl;
+        }
+        dump_threads(std::cerr);
+        for (const entry& e : m_tests) {
+            std::cout << "[   FAILED ] " << e.name << ((e.deadline <= now) ? " (timeout after " : " (aborted after ")
+                      << elapsed_ms(e.start, now) << " ms)" << std::endl;
+        }
+
+        if (m_on_abort) {
+            m_on_abort(m_finished + m_tests.size(), m_failed + m_tests.size());
+        }
+        std::cout << std::flush;
+        std::cerr << std::flush;
+        ::_exit(1);
+    }
+
+    static double elapsed_ms(clock::time_point start, clock::time_point now)
+    {
+        return std::chrono::duration<double, std::milli>(now - start).count();
+    }
+
+    /*
+     *  \brief  Backtraces of all threads but the calling one. Each thread is
+     *          interrupted in turn by a signal whose handler records its
+     *          frames, the frames are symbolized here.
+     */
+    static void dump_threads(std::ostream& os)
+    {
+#if defined(__TESTING_HAS_BACKTRACE)
+        const pid_t self_tid = (pid_t)::syscall(SYS_gettid);
+        DIR* p_dir = ::opendir("/proc/self/task");
+        if (p_dir == nullptr) {
+            return;
+        }
+        std::vector<pid_t> tids;
+        while (const dirent* p_entry = ::readdir(p_dir)) {
+            const pid_t tid = (pid_t)std::atoi(p_entry->d_name);
+            if (tid > 0 && tid != self_tid) {
+                tids.emplace_back(tid);
+            }
+        }
+        ::closedir(p_dir);
+
+        dump_state& st = state();
+        for (pid_t tid : tids) {
+            std::string name;
+            std::ifstream("/proc/self/task/" + std::to_string(tid) + "/comm") >> name;
+            os << "Thread " << tid << " (" << name << "):" << std::endl;
+
+            st.is_done.store(false, std::memory_order_relaxed);
+            st.target.store(tid, std::memory_order_release);
+            if (::syscall(SYS_tgkill, ::getpid(), tid, dump_signal()) != 0) {
+                st.target.store(0, std::memory_order_release);
+                os << "    <exited>" << std::endl;
+                continue;
+            }
+            if (! wait_dump(st, clock::now() + std::chrono::seconds(1))) {
+                /* A late answer must not overwrite the frames of the next thread. */
+                pid_t expected = tid;
+                if (st.target.compare_exchange_strong(expected, 0, std::memory_order_acq_rel)) {
+                    os << "    <no answer>" << std::endl;
+                    continue;
+                }
+                if (! wait_dump(st, clock::now() + std::chrono::seconds(1))) {
+                    os << "    <no answer>" << std::endl;
+                    break;
+                }
+            }
+            /* The first frames are the handler and the signal trampoline. */
+            for (int i = 2; i < st.depth; ++i) {
+                os << "    #" << (i - 2) << " " << symbolize(st.frames[i]) << std::endl;
+            }
+        }
+#else
+        os << "Backtraces are not supported" << std::endl;
+#endif
+    }
+
+    struct dump_state
+    {
+        static constexpr int max_frames = 64;
+
+        void* frames[max_frames];
+        int depth = 0;
+        /* Thread asked for its frames, -1 while it records them and 0 if none is asked. */
+        std::atomic<pid_t> target{0};
+        std::atomic<bool> is_done{false};
+    };
+
+    static bool wait_dump(const dump_state& st, clock::time_point deadline)
+    {
+        while (! st.is_done.load(std::memory_order_acquire) && clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        return st.is_done.load(std::memory_order_acquire);
+    }
+
+    static dump_state& state()
+    {
+        static dump_state st;
+        return st;
+    }
+
+    static int dump_signal() { return SIGRTMIN + 1; }
+
+    /* Installs the handler and loads the unwinder, which allocates, ahead of the dump. */
+    static void prepare_dump()
+    {
+#if defined(__TESTING_HAS_BACKTRACE)
+        state();
+        void* frames[1];
+        ::backtrace(frames, 1);
+
+        struct sigaction sa = {};
+        sa.sa_handler = [](int) {
+            dump_state& st = state();
+            pid_t tid = (pid_t)::syscall(SYS_gettid);
+            if (! st.target.compare_exchange_strong(tid, -1, std::memory_order_acq_rel)) {
+                return;
+            }
+            st.depth = ::backtrace(st.frames, dump_state::max_frames);
+            st.is_done.store(true, std::memory_order_release);
+        };
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        ::sigaction(dump_signal(), &sa, nullptr);
+#endif
+    }
+
+private:
+    std::unique_ptr<sync> m_p_sync;
+    std::unique_ptr<std::thread> m_p_thread;
+    std::list<entry> m_tests;
+    size_t m_last_id = 0;
+    size_t m_finished = 0;
+    size_t m_failed = 0;
+    bool m_is_stop = false;
+
+    abort_fn m_on_abort;
+    bool m_is_run_limited = false;
+    clock::time_point m_run_start;
+    clock::time_point m_run_deadline;
+    uint64_t m_run_timeout_ms = 0;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_WATCHDOG_H */
@@ -0,0 +1,128 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2023 Chistyakov Alexander.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _TESTING_WORK_STEALING_H
+#define _TESTING_WORK_STEALING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace testing {
+namespace details {
+
+/*
+ *  \brief  Runs tasks 0..count-1 on a number of threads. Every thread owns a
+ *          queue with a contiguous range of the tasks, so the neighbouring
+ *          tests of a suite run on the same thread, takes the tasks from its
+ *          front and steals from the back of the other queues when it is
+ *          empty.
+ */
+class work_stealing_pool final
+{
+public:
+    using task_fn = std::function<void(size_t)>;
+
+    explicit work_stealing_pool(size_t jobs)
+        : m_jobs(std::max<size_t>(1, jobs))
+    {}
+
+    void run(size_t count, const task_fn& fn)
+    {
+        m_queues.clear();
+        for (size_t i = 0; i < m_jobs; ++i) {
+            m_queues.emplace_back(new queue());
+            const size_t begin = count * i / m_jobs;
+            const size_t end = count * (i + 1) / m_jobs;
+            for (size_t task = begin; task < end; ++task) {
+                m_queues.back()->tasks.push_back(task);
+            }
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(m_jobs);
+        for (size_t i = 0; i < m_jobs; ++i) {
+            workers.emplace_back([this, i, &fn]() { work(i, fn); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+private:
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void work(size_t idx, const task_fn& fn)
+    {
+        size_t task = 0;
+        while (pop(idx, task) || steal(idx, task)) {
+            fn(task);
+        }
+    }
+
+    bool pop(size_t idx, size_t& task)
+    {
+        queue& q = *m_queues[idx];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        task = q.tasks.front();
+        q.tasks.pop_front();
+        return true;
+    }
+
+    /* Tasks are never added, so all queues are done once a full pass finds nothing. */
+    bool steal(size_t idx, size_t& task)
+    {
+        for (size_t i = 1; i < m_jobs; ++i) {
+            queue& q = *m_queues[(idx + i) % m_jobs];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (! q.tasks.empty()) {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const size_t m_jobs;
+    std::vector<std::unique_ptr<queue>> m_queues;
+};
+
+} // namespace details
+} // namespace testing
+
+#endif /* _TESTING_WORK_STEALING_H */
@@ -33,6 +33,62 @@
 
 #undef __PERFORMANCE_TESTS__
 
+#include <atomic>
+#include <type_traits>
+
+namespace testing {
+
+/*
+ *  \brief  Forces the compiler to materialize 'value' and to assume it is
+ *          read, so the code computing it is not eliminated.
+ */
+template<typename TType>
+inline void DoNotOptimize(const TType& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* p_sink;
+    p_sink = &value;
+#endif
+}
+
+/*
+ *  \brief  Same as above, but also assumes 'value' is modified, so the
+ *          computation is not hoisted out of the measured loop.
+ */
+template<typename TType>
+inline void DoNotOptimize(TType& value)
+{
+#if defined(__clang__)
+    asm volatile("" : "+r,m"(value) : : "memory");
+#elif defined(__GNUC__)
+    if constexpr (std::is_trivially_copyable<TType>::value && sizeof(TType) <= sizeof(void*)) {
+        asm volatile("" : "+m,r"(value) : : "memory");
+    } else {
+        asm volatile("" : "+m"(value) : : "memory");
+    }
+#else
+    static volatile void* p_sink;
+    p_sink = &value;
+#endif
+}
+
+/*
+ *  \brief  Forces all pending memory writes to be committed, as if any
+ *          memory could be read.
+ */
+inline void ClobberMemory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_acq_rel);
+#endif
+}
+
+} // namespace testing
+
 /*
  */
 
@@ -60,6 +116,14 @@
 #define PERF_INIT_TIMER(sw_name)                    \
     __PERF_INIT_HIERARCHY_TIMER(1, sw_name)
 
+/*
+ *  \brief  Timer recording its intervals into a constant memory histogram
+ *          instead of the sample buffer. Use it for timers paused millions
+ *          of times.
+ */
+#define PERF_INIT_HISTOGRAM_TIMER(sw_name)          \
+    __PERF_INIT_HISTOGRAM_TIMER(1, sw_name)
+
 #define PERF_START_TIMER(sw_name)                   \
     __PERF_START_TIMER_IMPL(sw_name)
 
@@ -72,6 +136,79 @@
 #define PERF_TIMER_MSECS(sw_name)                   \
     __PERF_TIMER_MSECS_IMPL(sw_name)
 
+/*
+ *  \brief  Fail the test if the intervals of the timer allocated on the heap
+ *          at all or more than 'n' times. Requires testing/alloc_hooks.h.
+ */
+#define PERF_EXPECT_NO_ALLOC(sw_name)               \
+    __PERF_EXPECT_MAX_ALLOCS_IMPL(sw_name, 0)
+
+#define PERF_EXPECT_MAX_ALLOCS(sw_name, n)          \
+    __PERF_EXPECT_MAX_ALLOCS_IMPL(sw_name, n)
+
+/*
+ *  \brief  Fail the test if the peak resident memory of the process since
+ *          the start of the run exceeds 'bytes'.
+ */
+#define PERF_EXPECT_MAX_RSS(bytes)                  \
+    __PERF_EXPECT_MAX_RSS_IMPL(bytes)
+
+/*
+ *  \brief  Bytes and items processed within the time of the timer, added up
+ *          over repeated calls. They are reported with the derived rate per
+ *          second.
+ */
+#define PERF_SET_BYTES(sw_name, n)                  \
+    __PERF_SET_TIMER_COUNTER_IMPL(sw_name, "bytes", n, bytes)
+
+#define PERF_SET_ITEMS(sw_name, n)                  \
+    __PERF_SET_TIMER_COUNTER_IMPL(sw_name, "items", n, items)
+
+/*
+ *  \brief  Adds to a named counter of the test body or of the benchmark loop,
+ *          repeated calls accumulate.
+ *          The kind is 'total', 'per_iteration' (per interval of the timer),
+ *          'rate' (per second of the timer), 'bytes' or 'items'.
+ *          PERF_TIMER_COUNTER attaches the counter to a named timer.
+ */
+#define PERF_COUNTER(name, value)                   \
+    __PERF_SET_COUNTER_IMPL(name, value, total)
+
+#define PERF_COUNTER_AS(name, value, kind)          \
+    __PERF_SET_COUNTER_IMPL(name, value, kind)
+
+#define PERF_TIMER_COUNTER(sw_name, name, value, kind)  \
+    __PERF_SET_TIMER_COUNTER_IMPL(sw_name, name, value, kind)
+
+/*
+ *  \brief  Selects the clock of the perf timers for the tests of a fixture.
+ *          Valid clocks: steady, monotonic_raw, thread_cpu, tsc. Call it
+ *          from the fixture constructor or SetUp().
+ */
+#define PERF_USE_CLOCK(clock_name)                  \
+    __PERF_USE_CLOCK_IMPL(clock_name)
+
+/*
+ *  \brief  Sets how many intervals of each perf timer are recorded for the
+ *          statistics in the tests of a fixture. Call it from the fixture
+ *          constructor or SetUp().
+ */
+#define PERF_SET_SAMPLES_LIMIT(limit)               \
+    __PERF_SET_SAMPLES_LIMIT_IMPL(limit)
+
+/*
+ *  \brief  Sets the minimal measured time of the PERF_BENCHMARK tests of a
+ *          fixture. Call it from the fixture constructor or SetUp().
+ */
+#define PERF_SET_MIN_TIME_MS(ms)                    \
+    __PERF_SET_MIN_TIME_MS_IMPL(ms)
+
+/*
+ *  \brief  Keeps the result of 'expr' from being optimized away.
+ */
+#define PERF_KEEP(expr)                             \
+    ::testing::DoNotOptimize(expr)
+
 #define PERF_CHECK_TIME(sw_name, funk)              \
     __PERF_START_TIMER_IMPL(sw_name);               \
     (funk);                                         \
@@ -89,12 +226,41 @@
 #define PERF_TEST_F(fixture, test_name)             \
     __PERF_TEST_F_IMPL(fixture, test_name)
 
+/*
+ *  \brief  Benchmark with an automatically chosen number of iterations.
+ *          The body loops 'for (auto _ : state)' and is rerun with more
+ *          iterations until the measured time reaches --perf_min_time_ms.
+ */
+#define PERF_BENCHMARK(fixture, test_name)          \
+    __PERF_BENCHMARK_IMPL(fixture, test_name)
+
+/*
+ *  \brief  Perf test whose body runs on 'threads' threads started together
+ *          by a barrier, each with its own perf timers and counters. The body
+ *          gets 'thread_index' and 'thread_count'. PERF_THREADS_SWEEP runs it
+ *          on 1, 2, 4, ... up to --perf_max_threads threads and reports the
+ *          scaling.
+ */
+#define PERF_TEST_MT(fixture, test_name, threads)   \
+    __PERF_TEST_MT_IMPL(fixture, test_name, threads)
+
+#define PERF_THREADS_SWEEP                          \
+    ::testing::details::threads_sweep
+
+/*
+ *  \brief  Attributes of a perf test, overriding the command line options:
+ *
+ *      PERF_TEST_ATTRS(fixture, test_name).warmups(1).repetitions(5);
+ */
+#define PERF_TEST_ATTRS(case_name, test_name)       \
+    __PERF_TEST_ATTRS_IMPL(case_name, test_name)
+
 #define TYPED_PERF_TEST_SUITE(case_name, types)     \
     __INIT_TYPED_PERF_TEST_SUITE(case_name, types)
 
 #define TYPED_PERF_TEST(case_name, types)           \
     __TYPED_PERF_TEST_IMPL(case_name, types)
 
-#define RUN_ALL_PERF_TESTS() ::testing::details::tester::run_all_tests()
+#define RUN_ALL_PERF_TESTS(...) ::testing::details::tester::run_all_tests(__VA_ARGS__)
 
 #endif /* _TESTING_PERFDEFS_H */
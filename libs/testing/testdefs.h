@@ -153,7 +153,20 @@
 #define TYPED_TEST(case_name, types)            \
     __TYPED_TEST_IMPL(case_name, types)
 
-#define RUN_ALL_TESTS() ::testing::details::tester::run_all_tests()
+/*
+ *  \brief  Attributes of a test or of all tests of a suite, e.g. to keep
+ *          the tests sharing state out of the parallel run of --jobs:
+ *
+ *      TEST_SUITE_ATTRS(case_name).serial();
+ *      TEST_ATTRS(case_name, test_name).serial();
+ */
+#define TEST_ATTRS(case_name, test_name)        \
+    __TEST_ATTRS_IMPL(case_name, test_name)
+
+#define TEST_SUITE_ATTRS(case_name)             \
+    __TEST_SUITE_ATTRS_IMPL(case_name)
+
+#define RUN_ALL_TESTS(...) ::testing::details::tester::run_all_tests(__VA_ARGS__)
 
 #endif /* _TESTING_TESTDEFS_H */
 
@@ -25,14 +25,27 @@
 #ifndef _TESTING_TESTING_INTERFACE_H
 #define _TESTING_TESTING_INTERFACE_H
 
+#include <algorithm>
+#include <exception>
 #include <functional>
-#include <list>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "testing/details/barrier.h"
+#include "testing/details/benchmark_state.h"
+#include "testing/details/counter_table.h"
+#include "testing/details/memory_usage.h"
+#include "testing/details/options.h"
+#include "testing/details/perf_report.h"
+#include "testing/details/stats.h"
 #include "testing/details/test_utils.h"
 #include "testing/details/tester.h"
+#include "testing/details/thread_tables.h"
 #include "testing/details/timer.h"
+#include "testing/details/timer_table.h"
 #include "testing/details/typed_test_utils.h"
 
 namespace testing {
@@ -57,6 +70,15 @@ inline Environment* AddGlobalTestEnvironment(Environment* p_env)
     return p_env;
 }
 
+/*
+ *  \brief  Seed of the current run to generate the test inputs reproducibly,
+ *          set by --seed, drawn and printed with --shuffle, fixed otherwise.
+ */
+inline uint32_t GetRandomSeed()
+{
+    return ::testing::details::options::get_instance().random_seed;
+}
+
 class Test
 {
 public:
@@ -76,31 +98,54 @@ public:
             }
             TearDown();
         } catch (const std::exception& ex) {
-            std::cerr << ex.what() << std::endl;
+            ut::err() << ex.what() << std::endl;
         }
     }
 #else
-    double __run_perf()
+    details::perf_result __run_perf(bool is_report)
     {
         namespace ut = ::testing::details;
 
-        ut::init_case();
-
-        double msecs = 0.0;
+        ut::perf_result result;
         try {
+            m_timers.clear();
+            m_counters.clear();
+            m_bench_iterations = 0;
+            m_bench_ns = 0;
+            m_thread_groups.clear();
+            details::thread_alloc_counts() = details::alloc_counts();
+            __start_memory_usage();
+
             SetUp();
             if (! ut::is_case_failed()) {
-                __register_sw(0, "test_body", ut::timer());
-                __get_sw("test_body").start();
+                ut::perf_clock::select(m_is_perf_clock_set ? m_perf_clock
+                                                           : ut::options::get_instance().perf_clock);
+                m_overhead_ns = ut::perf_timer_overhead_ns(ut::options::get_instance().perf_overhead);
+                m_overhead_noise_ns = (m_overhead_ns != 0) ? ut::perf_timer_calibration().noise_ns : 0;
+                m_timers.set_samples_limit(m_is_samples_limit_set ? m_samples_limit
+                                                                  : ut::options::get_instance().perf_samples);
+                m_timers.set_histogram(ut::options::get_instance().perf_histogram);
+                m_timers.set_events(m_events.open(ut::options::get_instance().perf_events) ? &m_events
+                                                                                           : nullptr);
+                m_timers.set_cpu_time(ut::options::get_instance().perf_cpu_time);
+                m_timers.set_cpu_tracking(ut::options::get_instance().perf_cpu_tracking);
+                m_timers.set_resources((ut::options::get_instance().perf_resources && m_resources.open())
+                                       ? &m_resources : nullptr);
+                ut::timer_table::handle body_sw = __register_sw(0, "test_body");
+                body_sw.start();
                 test_body();
-                __get_sw("test_body").pause();
+                body_sw.pause();
             }
             TearDown();
-            __print_timers();
+            m_memory_sampler.stop();
+            result = __collect_result();
+            if (is_report) {
+                ut::print_result(result);
+            }
         } catch (const std::exception& ex) {
             std::cerr << ex.what() << std::endl;
         }
-        return msecs;
+        return result;
     }
 #endif
 
@@ -112,15 +157,119 @@ protected:
     virtual void TearDown() {}
 
 #if defined(__PERFORMANCE_TESTS__)
-    details::timer& __get_sw(const std::string& sw_name) { return m_timers.at(sw_name); }
+    details::perf_timer& __get_sw(const std::string& sw_name) { return __timers().at(sw_name); }
+
+    details::timer_table::handle __cached_sw(details::timer_table::handle_cache& cache,
+                                             const char* sw_name)
+    {
+        return __timers().cached(cache, sw_name);
+    }
+
+    details::timer_table::handle __register_sw(size_t lvl, const std::string& sw_name,
+                                               bool is_histogram = false)
+    {
+        return __timers().register_timer(lvl, sw_name, is_histogram);
+    }
+
+    /* Tables of the calling thread of a multithreaded test, the test ones otherwise. */
+    details::timer_table& __timers()
+    {
+        details::thread_tables* p_tables = details::thread_tables::current();
+        return (p_tables != nullptr) ? p_tables->timers : m_timers;
+    }
+
+    details::counter_table& __counters()
+    {
+        details::thread_tables* p_tables = details::thread_tables::current();
+        return (p_tables != nullptr) ? p_tables->counters : m_counters;
+    }
+
+    void __use_perf_clock(details::clock_type type)
+    {
+        m_perf_clock = type;
+        m_is_perf_clock_set = true;
+    }
+
+    void __set_samples_limit(size_t limit)
+    {
+        m_samples_limit = limit;
+        m_is_samples_limit_set = true;
+    }
+
+    void __add_counter(const std::string& name, double value, details::counter_kind kind,
+                       size_t timer_idx = details::counter::main_timer)
+    {
+        __counters().add(name, value, kind, timer_idx);
+    }
+
+    void __set_min_time_ms(size_t ms)
+    {
+        m_min_time_ms = ms;
+        m_is_min_time_set = true;
+    }
+
+    /* Peak resident memory of the process since the start of the run. */
+    uint64_t __peak_rss_bytes() const
+    {
+        return m_is_peak_rss_reset ? details::peak_rss_bytes() : m_memory_sampler.peak_rss();
+    }
 
-    void __register_sw(size_t lvl, const std::string& sw_name, details::timer&& sw)
+    /*
+     *  \brief  Runs the body on 'threads' threads released together by a
+     *          barrier, or on 1, 2, 4, ... up to --perf_max_threads threads
+     *          for details::threads_sweep. Every thread has its own tables.
+     */
+    void __run_threads(size_t threads, const std::function<void(size_t, size_t)>& body)
     {
-        m_timers.emplace(sw_name, std::move(sw));
-        if (m_hierarchy.size() <= lvl) {
-            m_hierarchy.resize(lvl + 1);
+        if (threads != details::threads_sweep) {
+            m_thread_groups.emplace_back(__run_thread_group(threads, body));
+            return;
+        }
+
+        const size_t max_threads = details::options::get_instance().perf_max_threads;
+        const size_t limit = (max_threads != 0)
+            ? max_threads : std::max<size_t>(1, std::thread::hardware_concurrency());
+        for (size_t count = 1; ; count *= 2) {
+            count = std::min(count, limit);
+            m_thread_groups.emplace_back(__run_thread_group(count, body));
+            if (count == limit || details::is_case_failed()) {
+                break;
+            }
+        }
+    }
+
+    /*
+     *  \brief  Runs the benchmark body with a growing number of iterations
+     *          until the measured time reaches the minimal time.
+     */
+    void __run_benchmark(const std::function<void(details::benchmark_state&)>& body)
+    {
+        namespace ut = ::testing::details;
+
+        const uint64_t max_iterations = 1000000000;
+        const uint64_t min_ns = (m_is_min_time_set ? m_min_time_ms
+                                                   : ut::options::get_instance().perf_min_time_ms) * 1000000;
+        const size_t first_sw = m_timers.size();
+
+        uint64_t iterations = 1;
+        for (;;) {
+            m_timers.reset(first_sw);
+            m_counters.reset();
+            ut::benchmark_state state(iterations);
+            body(state);
+
+            const uint64_t ns = state.elapsed_ns();
+            if (ns >= min_ns || iterations >= max_iterations || ut::is_case_failed()) {
+                m_bench_iterations = iterations;
+                m_bench_ns = ns;
+                break;
+            }
+
+            /* Aim 40% above the minimal time, but grow 10 times at most. */
+            const double multiplier = (ns == 0) ? 10.0
+                : std::min(10.0, std::max(1.4 * (double)min_ns / (double)ns, 1.1));
+            iterations = std::min(max_iterations, (uint64_t)((double)iterations * multiplier) + 1);
         }
-        m_hierarchy[lvl].emplace_back(sw_name);
     }
 #endif
 
@@ -128,29 +277,219 @@ private:
     virtual void test_body() = 0;
 
 #if defined(__PERFORMANCE_TESTS__)
-    void __print_timers()
+    details::perf_result __collect_result()
+    {
+        details::perf_result result;
+        result.clock = details::clock_name(details::perf_clock::current());
+        result.overhead_ns = m_overhead_ns;
+        result.min_overhead_ns = (m_overhead_ns != 0) ? details::perf_timer_calibration().min_ns : 0;
+        result.overhead_noise_ns = m_overhead_noise_ns;
+        result.cycle_ns = details::cpu_cycle_ns();
+        result.bench_iterations = m_bench_iterations;
+        result.bench_ns = m_bench_ns;
+
+        __collect_tables(m_timers, m_counters, result);
+        /* Merged and freed out of the test body, the blocks are the ones of the workers. */
+        for (const thread_group& group : m_thread_groups) {
+            result.mt.emplace_back(details::merge_thread_results(group.wall_ns, group.results));
+        }
+        m_thread_groups.clear();
+
+        result.memory.rss_before = m_rss_before;
+        result.memory.rss_after = details::rss_bytes();
+        result.memory.is_peak_exact = m_is_peak_rss_reset;
+        result.memory.peak_rss = std::max(__peak_rss_bytes(), result.memory.rss_after);
+        result.memory.series = m_memory_sampler.samples();
+        return result;
+    }
+
+    /* Timers and counters of the tables, the main timer is the first one. */
+    void __collect_tables(const details::timer_table& timers, const details::counter_table& counters,
+                          details::perf_result& result) const
     {
-        const std::function<std::string(size_t)> shift_fn = [] (size_t h) -> std::string {
-            std::string shift = "  ";
-            for (size_t i = 0; i < h; ++i) {
-                shift += "  ";
+        const double ns_per_tick = details::perf_clock::ns_per_tick();
+        const std::vector<std::vector<size_t>>& hierarchy = timers.hierarchy();
+        std::vector<size_t> timer_pos(timers.size(), (size_t)-1);
+        for (size_t lvl = 0; lvl < hierarchy.size(); ++lvl) {
+            for (size_t idx : hierarchy[lvl]) {
+                const details::perf_timer& sw = timers.at(idx);
+                details::timer_result tr;
+                tr.name = timers.name(idx);
+                tr.level = lvl;
+                tr.ns = sw.value_ns();
+                tr.count = sw.count();
+                /* A corrected time within the overhead noise of zero is no measurement, keep the raw one. */
+                const uint64_t overhead_ns = tr.count * m_overhead_ns;
+                tr.is_corrected = (tr.ns > overhead_ns + tr.count * m_overhead_noise_ns);
+                tr.corrected_ns = tr.is_corrected ? tr.ns - overhead_ns : tr.ns;
+                tr.ns_per_tick = ns_per_tick;
+                tr.is_cpu_time = timers.is_cpu_time();
+                if (tr.is_cpu_time) {
+                    const uint64_t cpu_overhead_ns =
+                        tr.count * details::timer_table::cpu_time_overhead_ns();
+                    tr.cpu_ns = timers.cpu_ns(idx);
+                    tr.cpu_ns = (tr.cpu_ns > cpu_overhead_ns) ? tr.cpu_ns - cpu_overhead_ns : 0;
+                }
+                if (timers.get_resources() != nullptr) {
+                    tr.is_resources = true;
+                    tr.has_io = timers.get_resources()->has_io();
+                    tr.resources = timers.resources(idx);
+                }
+                tr.span_begin_ns = timers.span_begin_ns(idx);
+                tr.span_end_ns = timers.span_end_ns(idx);
+                if (timers.is_cpu_tracking()) {
+                    tr.placement = timers.placement(idx);
+                }
+                tr.is_allocs = details::is_alloc_hooks_installed();
+                tr.allocs = timers.allocs(idx);
+                const details::perf_events* p_events = timers.get_events();
+                for (size_t e = 0; p_events != nullptr && e < p_events->size(); ++e) {
+                    /* The counts of the reads around every interval are no measurement. */
+                    const double overhead = (double)tr.count * p_events->overhead().v[e];
+                    tr.events.emplace_back(p_events->name(e),
+                                           std::max(timers.events(idx).v[e] - overhead, 0.0));
+                }
+                if (sw.get_histogram() != nullptr) {
+                    tr.p_histogram = std::make_shared<details::histogram>(*sw.get_histogram());
+                    tr.stats = tr.p_histogram->summarize(ns_per_tick);
+                } else if (tr.count > 1) {
+                    tr.stats = details::summarize(sw.samples_ns());
+                }
+                timer_pos[idx] = result.timers.size();
+                result.timers.emplace_back(std::move(tr));
             }
-            return shift;
-        };
-
-        for (size_t i = 0; i < m_hierarchy.size(); ++i) {
-            const std::list<std::string>& timers = m_hierarchy[i];
-            const std::string shift = shift_fn(i);
-            for (const std::string& sw_name : timers) {
-                std::cout << "[   PERF   ] " << shift << sw_name << " time: "
-                          << __get_sw(sw_name).value_ms() << " msecs" << std::endl;
+        }
+
+        for (const details::counter& c : counters.counters()) {
+            details::counter_result cr;
+            cr.name = c.name;
+            cr.kind = c.kind;
+            cr.value = c.value;
+            if (c.timer_idx == details::counter::main_timer && result.bench_iterations != 0) {
+                cr.derived = details::derived_value(c, result.bench_ns, result.bench_iterations);
+            } else {
+                /* The timer may not have been reached, e.g. when SetUp failed. */
+                const size_t idx = (c.timer_idx == details::counter::main_timer) ? 0 : c.timer_idx;
+                if (idx >= timer_pos.size() || timer_pos[idx] >= result.timers.size()) {
+                    continue;
+                }
+                const details::timer_result& tr = result.timers[timer_pos[idx]];
+                cr.derived = details::derived_value(c, tr.corrected_ns, tr.count);
+                cr.timer_pos = timer_pos[idx];
             }
+            result.counters.emplace_back(std::move(cr));
+        }
+    }
+
+    /* Per thread results of a thread group, merged after the test body. */
+    struct thread_group
+    {
+        uint64_t wall_ns = 0;
+        std::vector<details::perf_result> results;
+    };
+
+    thread_group __run_thread_group(size_t threads, const std::function<void(size_t, size_t)>& body)
+    {
+        details::barrier start_barrier(threads + 1);
+        std::exception_ptr p_error;
+        std::mutex error_mutex;
+        std::vector<uint64_t> begin_ns(threads, 0);
+        std::vector<uint64_t> end_ns(threads, 0);
+        std::vector<details::perf_result> results(threads);
+        std::vector<details::alloc_counts> thread_allocs(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([&, i]() {
+                details::cpu_binding binding;
+                details::bind_perf_thread(binding, i);
+                {
+                    /* The tables are allocated and freed by their thread, as its heap counters expect. */
+                    details::thread_tables tables;
+                    tables.timers.copy_settings(m_timers);
+                    tables.timers.set_span(true);
+                    details::thread_tables::current() = &tables;
+                    details::timer_table::handle body_sw = tables.timers.register_timer(0, "thread_body");
+                    start_barrier.arrive_and_wait();
+                    begin_ns[i] = details::steady_clock::now();
+                    body_sw.start();
+                    try {
+                        body(i, threads);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (! p_error) {
+                            p_error = std::current_exception();
+                        }
+                    }
+                    body_sw.pause();
+                    end_ns[i] = details::steady_clock::now();
+                    details::thread_tables::current() = nullptr;
+                    __collect_tables(tables.timers, tables.counters, results[i]);
+                }
+                thread_allocs[i] = details::thread_alloc_counts();
+            });
+        }
+
+        start_barrier.arrive_and_wait();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        /*
+         *  Blocks of the workers are freed by this thread and the other way
+         *  around, their heap activity is merged into the counters of this
+         *  thread so the live bytes of the enclosing timers balance.
+         */
+        for (const details::alloc_counts& allocs : thread_allocs) {
+            details::thread_alloc_counts() += allocs;
+        }
+        /* The threads may run before the main one leaves the barrier. */
+        const uint64_t wall_ns = *std::max_element(end_ns.begin(), end_ns.end())
+                               - *std::min_element(begin_ns.begin(), begin_ns.end());
+        if (p_error) {
+            std::rethrow_exception(p_error);
+        }
+        thread_group group;
+        group.wall_ns = wall_ns;
+        group.results = std::move(results);
+        return group;
+    }
+
+    /*
+     *  \brief  Resets the peak RSS through clear_refs, or starts the sampler
+     *          thread where it is not permitted or the time series is wanted.
+     */
+    void __start_memory_usage()
+    {
+        const size_t series_ms = details::options::get_instance().perf_memory_series_ms;
+        const size_t fallback_period_ms = 1;
+
+        m_memory_sampler.stop();
+        m_is_peak_rss_reset = details::reset_peak_rss();
+        if (! m_is_peak_rss_reset || series_ms != 0) {
+            m_memory_sampler.start((series_ms != 0) ? series_ms : fallback_period_ms, series_ms != 0);
         }
+        m_rss_before = details::rss_bytes();
     }
 
 private:
-    std::unordered_map<std::string, details::timer> m_timers;
-    std::vector<std::list<std::string>> m_hierarchy;
+    details::timer_table m_timers;
+    details::counter_table m_counters;
+    details::perf_events m_events;
+    details::resource_reader m_resources;
+    details::clock_type m_perf_clock = details::clock_type::steady;
+    bool m_is_perf_clock_set = false;
+    uint64_t m_overhead_ns = 0;
+    uint64_t m_overhead_noise_ns = 0;
+    size_t m_samples_limit = 0;
+    bool m_is_samples_limit_set = false;
+    size_t m_min_time_ms = 0;
+    bool m_is_min_time_set = false;
+    uint64_t m_bench_iterations = 0;
+    uint64_t m_bench_ns = 0;
+    std::vector<thread_group> m_thread_groups;
+    details::memory_sampler m_memory_sampler;
+    bool m_is_peak_rss_reset = false;
+    uint64_t m_rss_before = 0;
 #endif
 };
 
@@ -18,6 +18,8 @@
 #include <string>
 
 #include "testing/testdefs.h"
+#include "testing/details/cpu_time.h"
+#include "testing/details/memory_usage.h"
 
 namespace testing {
 namespace utils {
@@ -176,7 +178,7 @@ inline bool remove_dir(const std::string& dir)
 }
 
 #ifdef __unix__
-    inline int cpu_ticks(const std::string& stat_path)
+    inline long long cpu_ticks(const std::string& stat_path)
     {
         struct stat_info_t
         {
@@ -195,10 +197,10 @@ inline bool remove_dir(const std::string& dir)
             unsigned int  cmin_flt;                 /** The number of minor faults with childs **/
             unsigned int  maj_flt;                  /** The number of major faults **/
             unsigned int  cmaj_flt;                 /** The number of major faults with childs **/
-            unsigned int  utime;                    /** user mode jiffies **/
-            unsigned int  stime;                    /** kernel mode jiffies **/
-            unsigned int  cutime;                   /** user mode jiffies with childs **/
-            unsigned int  cstime;                   /** kernel mode jiffies with childs **/
+            unsigned long utime;                    /** user mode jiffies **/
+            unsigned long stime;                    /** kernel mode jiffies **/
+            unsigned long cutime;                   /** user mode jiffies with childs **/
+            unsigned long cstime;                   /** kernel mode jiffies with childs **/
         };
 
         const int fd = ::open(stat_path.c_str(), O_RDONLY);
@@ -223,7 +225,7 @@ inline bool remove_dir(const std::string& dir)
          * running) are in columns 14 and 15.
          * https://linux.die.net/man/5/proc
          */
-        res = sscanf(buffer, "%d %s %c %d %d %d %d %d %u %u %u %u %u %u %u %u %u",
+        res = sscanf(buffer, "%d %s %c %d %d %d %d %d %u %u %u %u %u %lu %lu %lu %lu",
                             /* 1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17*/
                      &(info.pid),       /*  1 */
                      info.ex_name,      /*  2 */
@@ -244,12 +246,16 @@ inline bool remove_dir(const std::string& dir)
                      &(info.cstime));   /* 17 */
 
         ::close(fd);
-        return info.utime + info.stime;
+        if (res != 17) {
+            return -1;
+        }
+        return (long long)info.utime + (long long)info.stime;
     }
 
+    /* CPU time of the process described by 'stat_path', in jiffies resolution. */
     inline double cpu_time_msecs(const std::string& stat_path)
     {
-        int ticks = cpu_ticks(stat_path);
+        const long long ticks = cpu_ticks(stat_path);
         if (ticks == -1) {
             return 0.0;
         }
@@ -258,7 +264,25 @@ inline bool remove_dir(const std::string& dir)
         return (((double)ticks) / ((double)kClockTicksPerSec / 1000.0));
     }
 
-    inline double cpu_time_msecs_self() { return cpu_time_msecs("/proc/self/stat"); }
+    inline uint64_t cpu_time_nsecs_self() { return ::testing::details::process_cpu_time_ns(); }
+
+    inline double cpu_time_msecs_self() { return (double)cpu_time_nsecs_self() / 1000000.0; }
+
+    inline uint64_t thread_cpu_time_nsecs() { return ::testing::details::thread_cpu_time_ns(); }
+
+    inline double thread_cpu_time_msecs() { return (double)thread_cpu_time_nsecs() / 1000000.0; }
+
+    using cpu_usage = ::testing::details::cpu_usage;
+
+    /* User and system split of the CPU time of the process. */
+    inline cpu_usage process_cpu_usage() { return ::testing::details::process_cpu_usage(); }
+
+    /* User and system split of the CPU time of the calling thread. */
+    inline cpu_usage thread_cpu_usage() { return ::testing::details::thread_cpu_usage(); }
+
+    inline uint64_t rss_bytes() { return ::testing::details::rss_bytes(); }
+
+    inline uint64_t peak_rss_bytes() { return ::testing::details::peak_rss_bytes(); }
 
     inline int mem_usage()
     {
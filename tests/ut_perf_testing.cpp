@@ -22,10 +22,14 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <deque>
+#include <functional>
 #include <list>
+#include <random>
 #include <vector>
 
+#include "testing/alloc_hooks.h"
 #include "testing/perfdefs.h"
 
 class test_env : public ::testing::Environment
@@ -40,9 +44,21 @@ public:
 class test_fixture : public ::testing::Test
 {
 public:
+    test_fixture() { PERF_SET_MIN_TIME_MS(50); }
+
     virtual void SetUp() override {}
 };
 
+class tsc_fixture : public ::testing::Test
+{
+public:
+    tsc_fixture()
+    {
+        PERF_USE_CLOCK(tsc);
+        PERF_SET_SAMPLES_LIMIT(1000);
+    }
+};
+
 template<typename TType>
 class typed_fixture : public ::testing::Test
 {
@@ -50,6 +66,7 @@ public:
     virtual void SetUp() override
     {
         PERF_MESSAGE() << "typed_fixture::SetUp()";
+        PERF_INIT_TIMER(test);
     }
 };
 
@@ -57,6 +74,10 @@ using types = testing::Types<std::vector<size_t>, std::list<size_t>,
                              std::deque<size_t>>;
 TYPED_PERF_TEST_SUITE(typed_fixture, types);
 
+PERF_TEST_ATTRS(test_fixture, perf).warmups(1).repetitions(3);
+PERF_TEST_ATTRS(typed_fixture, perf).repetitions(2).max_cv(20.0);
+PERF_TEST_ATTRS(test_fixture, mt_sum).timeout_ms(60000);
+
 PERF_TEST_F(test_fixture, perf)
 {
     PERF_INIT_TIMER(test_perf);
@@ -69,15 +90,79 @@ PERF_TEST_F(test_fixture, perf)
     for (size_t i = 0; i < 10000; ++i) {
         PERF_START_TIMER(test_perf);
         dummy += v[i];
+        ::testing::DoNotOptimize(dummy);
         PERF_PAUSE_TIMER(test_perf);
     }
+    PERF_EXPECT_NO_ALLOC(test_perf);
+    PERF_SET_BYTES(test_perf, v.size() * sizeof(size_t));
+    PERF_SET_ITEMS(test_perf, v.size());
+    PERF_TIMER_COUNTER(test_perf, "sum", dummy, per_iteration);
+    PERF_COUNTER("size", v.size());
     PERF_MESSAGE() << "test_perf = " << PERF_TIMER_MSECS(test_perf) << " ms";
 }
 
-TYPED_PERF_TEST(typed_fixture, perf)
+PERF_TEST_F(test_fixture, histogram)
+{
+    PERF_INIT_HISTOGRAM_TIMER(test_perf);
+
+    std::mt19937 rng(::testing::GetRandomSeed());
+    std::vector<size_t> v(100000);
+    std::generate(v.begin(), v.end(), std::ref(rng));
+    PERF_EXPECT_MAX_RSS(1024 * 1024 * 1024);
+    size_t dummy = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        PERF_START_TIMER(test_perf);
+        dummy += v[i];
+        ::testing::DoNotOptimize(dummy);
+        PERF_PAUSE_TIMER(test_perf);
+    }
+}
+
+PERF_BENCHMARK(test_fixture, benchmark)
+{
+    std::vector<size_t> v(1000, 1);
+    size_t dummy = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < v.size(); ++i) {
+            dummy += v[i];
+        }
+        PERF_KEEP(dummy);
+        ::testing::ClobberMemory();
+    }
+    PERF_COUNTER_AS("bytes", state.iterations() * v.size() * sizeof(size_t), bytes);
+}
+
+PERF_TEST_MT(test_fixture, mt_sum, PERF_THREADS_SWEEP)
+{
+    PERF_INIT_TIMER(thread_sum);
+
+    std::vector<size_t> v(100000 / thread_count, thread_index);
+    size_t dummy = 0;
+    PERF_START_TIMER(thread_sum);
+    for (size_t i = 0; i < v.size(); ++i) {
+        dummy += v[i];
+        ::testing::DoNotOptimize(dummy);
+    }
+    PERF_PAUSE_TIMER(thread_sum);
+    PERF_SET_ITEMS(thread_sum, v.size());
+}
+
+PERF_TEST_F(tsc_fixture, perf)
 {
-    PERF_INIT_TIMER(test);
+    PERF_INIT_TIMER(test_perf);
+
+    std::vector<size_t> v(10000, 1);
+    size_t dummy = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        PERF_START_TIMER(test_perf);
+        dummy += v[i];
+        ::testing::DoNotOptimize(dummy);
+        PERF_PAUSE_TIMER(test_perf);
+    }
+}
 
+TYPED_PERF_TEST(typed_fixture, perf)
+{
     TypeParam v;
     for (size_t i = 0; i < 10000; ++i) {
         v.emplace_back(i);
@@ -87,11 +172,12 @@ TYPED_PERF_TEST(typed_fixture, perf)
     for (typename TypeParam::const_iterator it = v.cbegin(); it != v.cend(); ++it) {
         dummy += *it;
     }
+    PERF_KEEP(dummy);
     PERF_PAUSE_TIMER(test);
 }
 
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
     ::testing::AddGlobalTestEnvironment(new test_env());
-    return RUN_ALL_PERF_TESTS();
+    return RUN_ALL_PERF_TESTS(argc, argv);
 }
@@ -22,6 +22,19 @@
  * THE SOFTWARE.
  */
 
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "testing/details/cpu_affinity.h"
+#include "testing/details/histogram.h"
+#include "testing/details/perf_events.h"
+#include "testing/details/stats.h"
 #include "testing/testdefs.h"
 #include "testing/utils.h"
 
@@ -62,6 +75,8 @@ public:
     virtual void SetUp() override { EXPECT_TRUE(1 == 1); }
 };
 
+TEST_SUITE_ATTRS(test_fixture_2).serial();
+
 using types_1 = testing::Types<uint8_t, uint16_t, uint32_t>;
 TYPED_TEST_SUITE(typed_fixture_1, types_1);
 
@@ -134,6 +149,28 @@ TEST(case_name_2, expect_eq)
     EXPECT_EQ(1, 1);
 }
 
+TEST_ATTRS(case_name_2, expect_in_threads).serial();
+
+TEST(case_name_2, expect_in_threads)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i) {
+        threads.emplace_back([i]() {
+            EXPECT_TRUE(i < 4);
+            EXPECT_TRUE(i != 2) << "expected fail";
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+TEST(case_name_2, expect_in_parallel_threads)
+{
+    std::thread t([]() { EXPECT_TRUE(1 == 2) << "expected fail"; });
+    t.join();
+}
+
 TEST_F(test_fixture_1, expect_true)
 {
     EXPECT_TRUE(1 == 1);
@@ -164,9 +201,216 @@ TYPED_TEST(typed_fixture_2, test_name_1)
     EXPECT_TRUE(1 == 1);
 }
 
-int main(int /*argc*/, char** /*argv*/)
+TEST(filter, glob_match)
+{
+    using ::testing::details::glob_match;
+
+    EXPECT_TRUE(glob_match("", ""));
+    EXPECT_TRUE(glob_match("*", ""));
+    EXPECT_TRUE(glob_match("*", "suite.test"));
+    EXPECT_TRUE(glob_match("suite.test", "suite.test"));
+    EXPECT_TRUE(glob_match("suite.*", "suite.test"));
+    EXPECT_TRUE(glob_match("*.test", "suite.test"));
+    EXPECT_TRUE(glob_match("s?ite.t*t", "suite.test"));
+    EXPECT_TRUE(glob_match("*a*b*", "xaybz"));
+    EXPECT_TRUE(glob_match("a*b", "aXbYb"));
+    EXPECT_FALSE(glob_match("", "suite.test"));
+    EXPECT_FALSE(glob_match("suite", "suite.test"));
+    EXPECT_FALSE(glob_match("suite.test?", "suite.test"));
+    EXPECT_FALSE(glob_match("*a*b", "xaybz"));
+    EXPECT_FALSE(glob_match("Suite.*", "suite.test"));
+}
+
+TEST(filter, test_filter)
+{
+    using ::testing::details::test_filter;
+
+    EXPECT_TRUE(test_filter("").match("suite.test"));
+    EXPECT_TRUE(test_filter("suite.*").match("suite.test"));
+    EXPECT_FALSE(test_filter("suite.*").match("other.test"));
+    EXPECT_TRUE(test_filter("other.*:suite.test").match("suite.test"));
+    EXPECT_TRUE(test_filter("-*slow*").match("suite.test"));
+    EXPECT_FALSE(test_filter("-*slow*").match("suite.test_slow"));
+    EXPECT_TRUE(test_filter("suite.*:-*slow*").match("suite.test"));
+    EXPECT_FALSE(test_filter("suite.*:-*slow*").match("suite.test_slow"));
+    EXPECT_FALSE(test_filter("suite.*:-*slow*").match("other.test"));
+    EXPECT_FALSE(test_filter("-a.*:b.*").match("b.test"));
+}
+
+TEST(stats, summarize)
+{
+    const ::testing::details::summary odd = ::testing::details::summarize({4.0, 1.0, 3.0, 2.0, 5.0});
+    EXPECT_EQ(odd.count, 5u);
+    EXPECT_TRUE(odd.min == 1.0 && odd.max == 5.0);
+    EXPECT_TRUE(odd.mean == 3.0);
+    EXPECT_TRUE(odd.median == 3.0);
+    EXPECT_TRUE(std::fabs(odd.stddev - std::sqrt(2.5)) < 1e-12) << odd.stddev;
+    EXPECT_TRUE(std::fabs(odd.cv() - std::sqrt(2.5) / 3.0) < 1e-12) << odd.cv();
+    EXPECT_TRUE(std::fabs(odd.p90 - 4.6) < 1e-12) << odd.p90;
+
+    const ::testing::details::summary even = ::testing::details::summarize({1.0, 2.0, 3.0, 4.0});
+    EXPECT_TRUE(even.median == 2.5);
+
+    const ::testing::details::summary same = ::testing::details::summarize({7.0, 7.0, 7.0});
+    EXPECT_TRUE(same.stddev == 0.0 && same.cv() == 0.0);
+
+    const ::testing::details::summary empty = ::testing::details::summarize({});
+    EXPECT_EQ(empty.count, 0u);
+    EXPECT_TRUE(empty.median == 0.0 && empty.cv() == 0.0);
+}
+
+TEST(stats, histogram)
+{
+    ::testing::details::histogram h;
+    EXPECT_EQ(h.percentile(50.0), 0u);
+    for (uint64_t v = 1; v <= 100; ++v) {
+        h.record(v);
+    }
+    /* Values below the sub-bucket count are exact. */
+    EXPECT_EQ(h.count(), 100u);
+    EXPECT_EQ(h.percentile(0.0), 1u);
+    EXPECT_EQ(h.percentile(50.0), 50u);
+    EXPECT_EQ(h.percentile(90.0), 90u);
+    EXPECT_EQ(h.percentile(99.9), 100u);
+    EXPECT_EQ(h.percentile(100.0), 100u);
+
+    const ::testing::details::summary s = h.summarize(2.0);
+    EXPECT_TRUE(s.min == 2.0 && s.max == 200.0);
+    EXPECT_TRUE(s.mean == 101.0);
+    EXPECT_TRUE(s.median == 100.0);
+    EXPECT_TRUE(std::fabs(s.stddev - 2.0 * std::sqrt(101.0 * 100.0 / 12.0)) < 1e-9) << s.stddev;
+
+    /* Larger values are within the relative error of their sub-bucket. */
+    ::testing::details::histogram large;
+    for (uint64_t v = 1; v <= 1000; ++v) {
+        large.record(v * 1000);
+    }
+    const double p50 = (double)large.percentile(50.0);
+    const double p99 = (double)large.percentile(99.0);
+    EXPECT_TRUE(std::fabs(p50 - 500000.0) <= 500000.0 * 0.008) << p50;
+    EXPECT_TRUE(std::fabs(p99 - 990000.0) <= 990000.0 * 0.008) << p99;
+    EXPECT_EQ(large.percentile(100.0), 1000000u);
+
+    h.merge(large);
+    EXPECT_EQ(h.count(), 1100u);
+    EXPECT_EQ(h.percentile(100.0), 1000000u);
+    h.clear();
+    EXPECT_EQ(h.count(), 0u);
+}
+
+TEST(options, parse_cpu_list)
+{
+    using ::testing::details::parse_cpu_list;
+
+    std::vector<int> cpus;
+    EXPECT_TRUE(parse_cpu_list("3", cpus));
+    EXPECT_TRUE(cpus == std::vector<int>({3}));
+    EXPECT_TRUE(parse_cpu_list("0,2,4-7", cpus));
+    EXPECT_TRUE(cpus == std::vector<int>({0, 2, 4, 5, 6, 7}));
+    EXPECT_TRUE(parse_cpu_list("1-1", cpus));
+    EXPECT_TRUE(cpus == std::vector<int>({1}));
+    EXPECT_FALSE(parse_cpu_list("", cpus));
+    EXPECT_FALSE(parse_cpu_list("1,,2", cpus));
+    EXPECT_FALSE(parse_cpu_list("1,", cpus));
+    EXPECT_FALSE(parse_cpu_list("5-3", cpus));
+    EXPECT_FALSE(parse_cpu_list("1-", cpus));
+    EXPECT_FALSE(parse_cpu_list("-1", cpus));
+    EXPECT_FALSE(parse_cpu_list("a", cpus));
+    EXPECT_FALSE(parse_cpu_list("1234567", cpus));
+}
+
+/* Runs this binary with 'args', returns its exit status and the tests it lists. */
+static int run_self(const std::string& args, std::vector<std::string>& tests)
+{
+    char path[4096];
+    const ssize_t path_size = ::readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (path_size <= 0) {
+        return -1;
+    }
+    path[path_size] = '\0';
+
+    FILE* p_pipe = ::popen(("'" + std::string(path) + "' " + args + " 2>/dev/null").c_str(), "r");
+    if (p_pipe == nullptr) {
+        return -1;
+    }
+
+    std::string suite;
+    char buffer[256];
+    while (::fgets(buffer, sizeof(buffer), p_pipe) != nullptr) {
+        std::string line(buffer);
+        line.erase(line.find_last_not_of('\n') + 1);
+        if (line.rfind("  ", 0) == 0) {
+            tests.emplace_back(suite + line.substr(2));
+        } else if (! line.empty() && line.back() == '.') {
+            suite = line;
+        }
+    }
+    const int status = ::pclose(p_pipe);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+TEST(options, shards)
+{
+    std::vector<std::string> all_tests;
+    ASSERT_TRUE(run_self("--list --shard=0/1", all_tests) == 0);
+    ASSERT_TRUE(all_tests.size() > 3) << all_tests.size();
+
+    /* Every test runs in exactly one shard and the shards are balanced. */
+    std::multiset<std::string> shard_tests;
+    for (size_t i = 0; i < 3; ++i) {
+        std::vector<std::string> tests;
+        EXPECT_TRUE(run_self("--list --shard=" + std::to_string(i) + "/3", tests) == 0);
+        EXPECT_TRUE(tests.size() == all_tests.size() / 3 || tests.size() == all_tests.size() / 3 + 1)
+            << "shard " << i << " has " << tests.size() << " of " << all_tests.size() << " tests";
+        shard_tests.insert(tests.begin(), tests.end());
+    }
+    EXPECT_TRUE(shard_tests == std::multiset<std::string>(all_tests.begin(), all_tests.end()));
+
+    std::vector<std::string> tests;
+    EXPECT_EQ(run_self("--list --shard=3/3", tests), 1);
+    EXPECT_EQ(run_self("--list --shard=0/0", tests), 1);
+    EXPECT_TRUE(tests.empty());
+}
+
+TEST(perf_events, context_switches)
+{
+    ::testing::details::perf_events events;
+    if (! events.open(::testing::details::perf_events_mode::sw)) {
+        return;
+    }
+
+    ::testing::details::perf_events::sample start;
+    ::testing::details::perf_events::sample end;
+    events.read(start);
+    for (size_t i = 0; i < 20; ++i) {
+        ::usleep(1000);
+    }
+    events.read(end);
+    ::testing::details::perf_events::values counts;
+    events.accumulate(start, end, counts);
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (events.name(i) == "context-switches") {
+            EXPECT_TRUE(counts.v[i] >= 20.0) << "context-switches " << counts.v[i];
+        }
+    }
+}
+
+TEST(utils, cpu_usage)
+{
+    const uint64_t start_ns = ::testing::utils::thread_cpu_time_nsecs();
+    while (::testing::utils::thread_cpu_time_nsecs() - start_ns < 20000000) {
+    }
+
+    const ::testing::utils::cpu_usage thread_usage = ::testing::utils::thread_cpu_usage();
+    const ::testing::utils::cpu_usage process_usage = ::testing::utils::process_cpu_usage();
+    EXPECT_TRUE(thread_usage.total_ns() >= 10000000) << thread_usage.total_ns();
+    EXPECT_TRUE(thread_usage.total_ns() == thread_usage.user_ns + thread_usage.system_ns);
+    EXPECT_TRUE(process_usage.total_ns() >= 10000000) << process_usage.total_ns();
+}
+
+int main(int argc, char** argv)
 {
     ::testing::AddGlobalTestEnvironment(new test_env());
-    return RUN_ALL_TESTS();
+    return RUN_ALL_TESTS(argc, argv);
 }
 